@@ -0,0 +1,121 @@
+#include "include/async_loader.h"
+#include "include/scene_cache.h"
+
+#include <iostream>
+
+
+AsyncSceneLoader::AsyncSceneLoader(Window &shared, const LoadOptions &options, const std::string &cacheDir,
+                                   bool useCache)
+    : options(options), cacheDir(cacheDir), useCache(useCache)
+{
+    // the loader builds complete scenes, streaming textures is a render thread feature
+    this->options.progressive = false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "gltf viewer loader", NULL, shared.window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!context) {
+        std::cout << "Failed to create the loader context, models cannot be switched at runtime" << std::endl;
+        return;
+    }
+
+    thread = std::thread(&AsyncSceneLoader::run, this);
+}
+
+AsyncSceneLoader::~AsyncSceneLoader()
+{
+    if (thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    // scenes that were never picked up, the main context shares their objects
+    for (Result &result : finished) {
+        glDeleteSync(result.fence);
+        result.scene.release();
+    }
+    if (context) {
+        glfwDestroyWindow(context);
+    }
+}
+
+void AsyncSceneLoader::request(const std::string &filename)
+{
+    if (!context) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requested = filename;
+    }
+    wake.notify_one();
+}
+
+bool AsyncSceneLoader::poll(RenderScene &scene, std::string &filename)
+{
+    Result result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished.empty()) return false;
+
+        // never block the frame, check again next time
+        GLenum status = glClientWaitSync(finished.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) return false;
+
+        result = std::move(finished.front());
+        finished.pop_front();
+    }
+
+    glDeleteSync(result.fence);
+    createVertexArrays(result.scene);
+    scene.release();
+    scene = std::move(result.scene);
+    filename = result.filename;
+    return true;
+}
+
+bool AsyncSceneLoader::build(const std::string &filename, RenderScene &scene)
+{
+    SceneCache cache(cacheDir, filename, options);
+    if (useCache && cache.open() && cache.upload(scene)) {
+        return true;
+    }
+
+    LoadedModel loaded;
+    if (!loadModel(loaded, filename, options)) return false;
+    scene = bindModel(loaded);
+    if (useCache) {
+        cache.write(scene, loaded);
+    }
+    return true;
+}
+
+void AsyncSceneLoader::run()
+{
+    glfwMakeContextCurrent(context);
+
+    while (true) {
+        std::string filename;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !requested.empty(); });
+            if (stopping) break;
+            filename.swap(requested);
+        }
+
+        Result result;
+        result.filename = filename;
+        if (!build(filename, result.scene)) continue;
+
+        // the render thread may only use the objects once the GPU has executed the uploads
+        result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        finished.push_back(std::move(result));
+    }
+
+    glfwMakeContextCurrent(NULL);
+}
@@ -0,0 +1,270 @@
+#include "include/base64.h"
+#include "tiny_gltf.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// table entry of characters outside the alphabet
+const uint32_t INVALID = 0x100;
+
+// kernels by speed, decodeBase64 takes the fastest the CPU runs
+enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE41,
+    KERNEL_AVX2,
+};
+
+struct DecodeTable {
+    uint32_t values[256];
+
+    DecodeTable() {
+        for (uint32_t &value : values) value = INVALID;
+        for (uint32_t i = 0; i < 64; ++i) values[(unsigned char) ALPHABET[i]] = i;
+    }
+};
+
+const DecodeTable &decodeTable() {
+    static const DecodeTable table;
+    return table;
+}
+
+// `quads` groups of 4 characters into 3 bytes each, false on a character outside the alphabet
+bool decodeScalar(const unsigned char *src, size_t quads, unsigned char *dst) {
+    const uint32_t *table = decodeTable().values;
+    uint32_t invalid = 0;
+    for (size_t i = 0; i < quads; ++i, src += 4, dst += 3) {
+        uint32_t a = table[src[0]], b = table[src[1]], c = table[src[2]], d = table[src[3]];
+        invalid |= a | b | c | d;
+        uint32_t v = a << 18 | b << 12 | c << 6 | d;
+        dst[0] = (unsigned char) (v >> 16);
+        dst[1] = (unsigned char) (v >> 8);
+        dst[2] = (unsigned char) v;
+    }
+    return (invalid & INVALID) == 0;
+}
+
+#ifdef BASE64_X86
+
+// Both kernels map 16 characters per 128-bit lane to their 6-bit values with
+// nibble lookups (pshufb), reject the block when a character is outside the
+// alphabet and pack 4 values into 3 bytes with two multiply-adds. Each store
+// writes 4 bytes per lane past the decoded ones, so the loops stop while enough
+// input is left to cover them. They return the characters they decoded; an
+// invalid block is left to the scalar loop, which reports it.
+
+__attribute__((target("sse4.1"))) size_t decodeSse41(const unsigned char *src, size_t size, unsigned char *dst) {
+    // bit sets of the low and high nibble, their AND is 0 only for alphabet characters
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a,
+                                        0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                        0x10, 0x10, 0x10, 0x10);
+    // offset from a character to its value by high nibble, '/' shares its nibble with '+'
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask2F = _mm_set1_epi8(0x2f);
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    for (; i + 24 <= size; i += 16, dst += 12) {
+        __m128i str = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask2F);
+        __m128i loNibbles = _mm_and_si128(str, mask2F);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm_testz_si128(lo, hi)) break;
+
+        __m128i eq2F = _mm_cmpeq_epi8(str, mask2F);
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(eq2F, hiNibbles));
+        str = _mm_add_epi8(str, roll);
+
+        // aaaaaa bbbbbb cccccc dddddd -> 24 bits per 32-bit lane, then the 3 bytes big endian
+        __m128i merged = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        __m128i out = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        out = _mm_shuffle_epi8(out, pack);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), out);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) size_t decodeAvx2(const unsigned char *src, size_t size, unsigned char *dst) {
+    const __m256i lutLo = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+    const __m256i lutHi = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    const __m256i lutRoll = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    const __m256i mask2F = _mm256_set1_epi8(0x2f);
+    const __m256i pack = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    // the 12 bytes of both lanes next to each other
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+    size_t i = 0;
+    for (; i + 44 <= size; i += 32, dst += 24) {
+        __m256i str = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(str, 4), mask2F);
+        __m256i loNibbles = _mm256_and_si256(str, mask2F);
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        if (!_mm256_testz_si256(lo, hi)) break;
+
+        __m256i eq2F = _mm256_cmpeq_epi8(str, mask2F);
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, hiNibbles));
+        str = _mm256_add_epi8(str, roll);
+
+        __m256i merged = _mm256_maddubs_epi16(str, _mm256_set1_epi32(0x01400140));
+        __m256i out = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        out = _mm256_shuffle_epi8(out, pack);
+        out = _mm256_permutevar8x32_epi32(out, lanes);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), out);
+    }
+    return i;
+}
+
+Kernel fastestKernel() {
+    static const Kernel kernel = __builtin_cpu_supports("avx2")     ? KERNEL_AVX2
+                                 : __builtin_cpu_supports("sse4.1") ? KERNEL_SSE41
+                                                                    : KERNEL_SCALAR;
+    return kernel;
+}
+
+#else
+
+Kernel fastestKernel() {
+    return KERNEL_SCALAR;
+}
+
+#endif
+
+bool decode(const char *src, size_t size, std::vector<unsigned char> &out, Kernel kernel) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t padding = 0;
+    if (size >= 1 && in[size - 1] == '=') padding = size >= 2 && in[size - 2] == '=' ? 2 : 1;
+    size_t chars = size - padding;
+    // a single character left over holds no whole byte, padding only completes a group of 4
+    if (chars % 4 == 1 || (padding > 0 && size % 4 != 0)) return false;
+
+    size_t tail = chars % 4;
+    out.resize(chars / 4 * 3 + (tail ? tail - 1 : 0));
+    unsigned char *dst = out.data();
+    size_t whole = chars - tail;
+    size_t done = 0;
+
+#ifdef BASE64_X86
+    if (kernel >= KERNEL_AVX2) done += decodeAvx2(in + done, whole - done, dst + done / 4 * 3);
+    if (kernel >= KERNEL_SSE41) done += decodeSse41(in + done, whole - done, dst + done / 4 * 3);
+#else
+    (void) kernel;
+#endif
+    if (!decodeScalar(in + done, (whole - done) / 4, dst + done / 4 * 3)) return false;
+
+    if (tail) {
+        const uint32_t *table = decodeTable().values;
+        uint32_t a = table[in[whole]], b = table[in[whole + 1]], c = tail == 3 ? table[in[whole + 2]] : 0;
+        if ((a | b | c) & INVALID) return false;
+        uint32_t v = a << 18 | b << 12 | c << 6;
+        unsigned char *last = dst + whole / 4 * 3;
+        last[0] = (unsigned char) (v >> 16);
+        if (tail == 3) last[1] = (unsigned char) (v >> 8);
+    }
+    return true;
+}
+
+std::string encode(const std::vector<unsigned char> &bytes) {
+    std::string out;
+    out.reserve((bytes.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < bytes.size(); i += 3) {
+        uint32_t v = (uint32_t) bytes[i] << 16;
+        if (i + 1 < bytes.size()) v |= (uint32_t) bytes[i + 1] << 8;
+        if (i + 2 < bytes.size()) v |= bytes[i + 2];
+        out += ALPHABET[(v >> 18) & 63];
+        out += ALPHABET[(v >> 12) & 63];
+        out += i + 1 < bytes.size() ? ALPHABET[(v >> 6) & 63] : '=';
+        out += i + 2 < bytes.size() ? ALPHABET[v & 63] : '=';
+    }
+    return out;
+}
+
+bool tinygltfDecoder(const char *in, size_t size, std::vector<unsigned char> *out) {
+    return decodeBase64(in, size, *out);
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+
+bool decodeBase64(const char *src, size_t size, std::vector<unsigned char> &out) {
+    return decode(src, size, out, fastestKernel());
+}
+
+void installBase64Decoder() {
+    tinygltf::SetBase64Decoder(tinygltfDecoder);
+}
+
+void benchmarkBase64(size_t megabytes, int runs) {
+    // odd length, so the padding and the scalar tail are part of every run
+    std::vector<unsigned char> bytes(megabytes * 1024 * 1024 + 1);
+    uint32_t state = 0x9e3779b9;
+    for (unsigned char &byte : bytes) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        byte = (unsigned char) state;
+    }
+    const std::string header = "data:application/octet-stream;base64,";
+    const std::string uri = header + encode(bytes);
+    double encodedMB = (uri.size() - header.size()) / (1024.0 * 1024.0);
+    std::cout << "base64: " << bytes.size() / (1024.0 * 1024.0) << " MB from " << encodedMB << " MB of text"
+              << std::endl;
+
+    auto measure = [&](const char *name, const std::function<bool(std::vector<unsigned char> &)> &run) {
+        double best = 0.0, total = 0.0;
+        std::vector<unsigned char> out;
+        for (int i = 0; i < runs; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = run(out);
+            double ms = msSince(start);
+            if (!ok || out != bytes) {
+                std::cout << name << ": decoded data does not match" << std::endl;
+                return;
+            }
+            best = i == 0 ? ms : std::min(best, ms);
+            total += ms;
+        }
+        std::cout << name << ": best " << best << " ms, mean " << total / runs << " ms, "
+                  << encodedMB / (best / 1000.0) << " MB/s over " << runs << " runs" << std::endl;
+    };
+
+    std::string mime;
+    tinygltf::SetBase64Decoder(nullptr);
+    measure("tinygltf DecodeDataURI", [&](std::vector<unsigned char> &out) {
+        return tinygltf::DecodeDataURI(&out, mime, uri, bytes.size(), true);
+    });
+    installBase64Decoder();
+    measure("DecodeDataURI with decodeBase64", [&](std::vector<unsigned char> &out) {
+        return tinygltf::DecodeDataURI(&out, mime, uri, bytes.size(), true);
+    });
+
+    static const char *names[] = {"scalar", "sse4.1", "avx2"};
+    for (int kernel = KERNEL_SCALAR; kernel <= fastestKernel(); ++kernel) {
+        measure(names[kernel], [&](std::vector<unsigned char> &out) {
+            return decode(uri.data() + header.size(), uri.size() - header.size(), out, (Kernel) kernel);
+        });
+    }
+}
@@ -0,0 +1,35 @@
+#include "include/buffer_arena.h"
+
+#include <algorithm>
+
+
+BufferArena::BufferArena(RenderScene &scene, size_t pageSize)
+    : scene(scene), pageSize(pageSize)
+{
+}
+
+ArenaRange BufferArena::allocate(size_t size, size_t alignment)
+{
+    for (Page &page : pages) {
+        size_t offset = (page.used + alignment - 1) / alignment * alignment;
+        if (offset + size <= page.capacity) {
+            page.used = offset + size;
+            scene.bufferSizes[page.sceneIndex] = page.used;
+            return ArenaRange{page.buffer, offset};
+        }
+    }
+
+    // ranges larger than a page get a page of their own
+    Page page;
+    page.capacity = std::max(pageSize, size);
+    page.used = size;
+    glGenBuffers(1, &page.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, page.buffer);
+    glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) page.capacity, NULL, GL_STATIC_DRAW);
+
+    page.sceneIndex = scene.buffers.size();
+    scene.buffers.push_back(page.buffer);
+    scene.bufferSizes.push_back(page.used);
+    pages.push_back(page);
+    return ArenaRange{page.buffer, 0};
+}
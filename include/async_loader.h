@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad.h>
+#include <GLFW/glfw3.h>
+#include "loader.h"
+#include "scene.h"
+#include "window.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+// Loads models on a worker thread that owns a hidden window whose context
+// shares objects with the main window. Buffers and textures are created and
+// uploaded there and fenced with glFenceSync; the render thread only checks
+// the fence, builds the VAOs and swaps the scene in.
+class AsyncSceneLoader
+{
+public:
+    // creates the shared context, so it has to run on the main thread
+    AsyncSceneLoader(Window &shared, const LoadOptions &options, const std::string &cacheDir, bool useCache);
+    ~AsyncSceneLoader();
+
+    AsyncSceneLoader(const AsyncSceneLoader &) = delete;
+    AsyncSceneLoader &operator=(const AsyncSceneLoader &) = delete;
+
+    // queues a load, replacing a request that has not started yet
+    void request(const std::string &filename);
+    // replaces `scene` with a finished load once the GPU has consumed its uploads
+    bool poll(RenderScene &scene, std::string &filename);
+
+private:
+    struct Result {
+        std::string filename;
+        RenderScene scene;
+        GLsync fence;
+    };
+
+    void run();
+    bool build(const std::string &filename, RenderScene &scene);
+
+    GLFWwindow *context;
+    LoadOptions options;
+    std::string cacheDir;
+    bool useCache;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::string requested;
+    bool stopping = false;
+    std::deque<Result> finished;
+
+    std::thread thread;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Decodes `size` base64 characters into `out`, padding at the end is optional.
+// Blocks of 32 or 16 characters go through AVX2 or SSE4.1 where the CPU has
+// them, the rest through a table. False for characters outside the alphabet
+// or a length no encoder produces.
+bool decodeBase64(const char *src, size_t size, std::vector<unsigned char> &out);
+
+// makes tinygltf decode data URIs of buffers and images with decodeBase64,
+// straight into the buffer or image instead of through temporary strings
+void installBase64Decoder();
+
+// encodes `megabytes` MB of random bytes, decodes them `runs` times with
+// tinygltf's decoder and each of ours and prints the throughput of each
+void benchmarkBase64(size_t megabytes, int runs);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad.h>
+#include "scene.h"
+#include <cstddef>
+#include <vector>
+
+
+// a sub-allocated range of one of the arena's buffers
+struct ArenaRange {
+    GLuint buffer;
+    size_t offset;
+};
+
+// Large GL buffers geometry is sub-allocated from instead of one buffer per
+// bufferView. Ranges are handed out from the front of a page; a new page is
+// created when a range fits in none of the existing ones. Pages are owned by
+// the RenderScene, which also learns how many bytes of each are in use.
+class BufferArena
+{
+public:
+    BufferArena(RenderScene &scene, size_t pageSize);
+
+    // `size` bytes starting at a multiple of `alignment`, which need not be a power of two
+    ArenaRange allocate(size_t size, size_t alignment);
+
+    size_t pageCount() const { return pages.size(); }
+
+private:
+    struct Page {
+        GLuint buffer;
+        size_t capacity;
+        size_t used;
+        // index into RenderScene::buffers and bufferSizes
+        size_t sceneIndex;
+    };
+
+    RenderScene &scene;
+    size_t pageSize;
+    std::vector<Page> pages;
+};
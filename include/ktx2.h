@@ -0,0 +1,19 @@
+#pragma once
+
+#include "texture_compress.h"
+#include "tiny_gltf.h"
+#include <cstddef>
+#include <string>
+
+
+// true when `bytes` start with the KTX2 file identifier
+bool isKtx2(const unsigned char *bytes, size_t size);
+
+// Reads a KTX2 texture. BC1/BC3/BC4/BC5/BC7 data fills `blocks` with every mip
+// level of the file and `image` with its size and channels only. 8-bit
+// uncompressed formats fill `image` with level 0, further levels are left to
+// glGenerateMipmap. Zstandard supercompressed levels are inflated first. Basis
+// Universal payloads (ETC1S, UASTC), other formats and levels whose size does not
+// match the image are rejected with `err` set.
+bool loadKtx2(const unsigned char *bytes, size_t size, tinygltf::Image &image, CompressedImage &blocks,
+              std::string &err);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+
+// Where the load went: wall-clock time and heap allocations per stage, bytes
+// read, decoded and uploaded per asset. Collected from any thread and printed
+// by --load-report. GL stages time the submission, not the GPU work.
+namespace loadreport {
+
+// stage timer, nested and repeated stages add up under their name
+class Stage
+{
+public:
+    explicit Stage(const char *name);
+    ~Stage();
+
+    Stage(const Stage &) = delete;
+    Stage &operator=(const Stage &) = delete;
+
+private:
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+    size_t allocations;
+    size_t allocatedBytes;
+};
+
+// asset kinds, `name` is a path, uri or glTF name
+void addRead(const std::string &name, size_t bytes);
+void addDecoded(const std::string &name, size_t encodedBytes, size_t decodedBytes, double ms);
+void addUploaded(const char *kind, const std::string &name, size_t bytes, double ms);
+
+// heap allocations since the process started, counted by the replaced operator new
+size_t allocationCount();
+size_t allocatedBytes();
+
+void print(std::ostream &out);
+void printJson(std::ostream &out);
+
+// clears everything recorded so far, allocation counters keep running
+void reset();
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "tiny_gltf.h"
+#include "mapped_file.h"
+#include "texture_compress.h"
+#include <string>
+#include <vector>
+
+
+struct LoadOptions {
+    // worker threads decoding images, 0 = one per hardware thread,
+    // 1 = tinygltf's own serial decoder
+    unsigned int threads = 0;
+    // read external buffers and images through mmap instead of ifstream
+    bool mappedIo = true;
+    // false leaves Image::image empty, used to time I/O on its own
+    bool decodeImages = true;
+    // return before images are decoded and hand them over in LoadedModel::pendingImages
+    bool progressive = false;
+    // block-compress 8-bit images once they are decoded, see texture_compress.h
+    bool compressTextures = false;
+    // RGBA images with alpha become BC7 instead of BC3, needs BPTC support
+    bool compressBc7 = false;
+    // where compressed images are kept between runs, empty keeps them in memory only
+    std::string textureCacheDir;
+    // print warnings and the load summary
+    bool verbose = true;
+};
+
+// encoded image captured while tinygltf parses, decoded once parsing is done
+struct PendingImage {
+    int index;
+    int reqWidth;
+    int reqHeight;
+    std::vector<unsigned char> bytes;
+};
+
+// a loaded glTF model together with the storage backing its buffers.
+// KHR_texture_basisu is not supported, its Basis Universal images are not
+// transcoded and such textures keep their fallback source.
+struct LoadedModel {
+    tinygltf::Model model;
+    // mapped .glb or external .bin files, buffers are uploaded straight from these pages
+    std::vector<MappedFile> files;
+    // payload of every buffer, either Buffer::data or a range of one of `files`
+    std::vector<const unsigned char *> bufferData;
+    // byte length of every buffer, Buffer::data is empty for mapped ones
+    std::vector<size_t> bufferSizes;
+    // images still to be decoded when loaded with LoadOptions::progressive
+    std::vector<PendingImage> pendingImages;
+    // one per image with LoadOptions::compressTextures or KTX2 images, format
+    // BLOCK_NONE where the image is not block compressed
+    std::vector<CompressedImage> compressedImages;
+    bool compressTextures = false;
+    bool compressBc7 = false;
+    std::string textureCacheDir;
+    // LoadOptions::threads, for the pools that keep working on the model after loading
+    unsigned int threads = 0;
+
+    const unsigned char *buffer(int index) const { return bufferData[index]; }
+    // blocks of image `index`, nullptr when it is not compressed
+    const CompressedImage *compressed(int index) const {
+        if (compressedImages.empty() || compressedImages[index].format == BLOCK_NONE) return nullptr;
+        return &compressedImages[index];
+    }
+};
+
+// loads and validates a .gltf or .glb file, all images are decoded when this
+// returns. Buffer views with EXT_meshopt_compression are decoded, see
+// meshopt_decode.h. KHR_draco_mesh_compression is not supported, files that
+// require it fail to load
+bool loadModel(LoadedModel &loaded, const std::string &filename,
+               const LoadOptions &options = LoadOptions());
+
+// name of an image in the load report: its index followed by its name or uri
+std::string assetName(const tinygltf::Image &image, int index);
+
+// decodes a deferred image into model.images[image.index] and frees its encoded bytes
+bool decodeImage(tinygltf::Model &model, PendingImage &image, std::string &err, std::string &warn);
+
+// decodes a deferred image like decodeImage(). With texture compression on it is
+// compressed into loaded.compressedImages instead, or taken from the texture cache
+// without decoding, and the decoded pixels are freed.
+bool prepareImage(LoadedModel &loaded, PendingImage &image, std::string &err, std::string &warn);
+
+// frees what only the upload needed: decoded pixels, buffer payloads and file
+// mappings. Accessors, materials and the rest of the model stay valid.
+void releasePayloads(LoadedModel &loaded);
+
+// resident set size of the process in bytes, 0 where it cannot be queried
+size_t residentBytes();
+
+// loads `filename` `runs` times with the serial decoder and with `options`
+// and prints the wall-clock times of both
+void benchmarkLoad(const std::string &filename, const LoadOptions &options, int runs);
+
+// loads `filename` `runs` times without decoding images, once through
+// tinygltf's ifstream callbacks and once through mmap, and prints both
+void benchmarkIo(const std::string &filename, const LoadOptions &options, int runs);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "loader.h"
+#include <cstddef>
+#include <string>
+
+
+// filters of EXT_meshopt_compression, applied to ATTRIBUTES data after decoding
+enum MeshoptFilter {
+    MESHOPT_FILTER_NONE,
+    // unit vectors as octahedral x/y, 4 or 8 bytes per element
+    MESHOPT_FILTER_OCTAHEDRAL,
+    // unit quaternions as three components and the index of the largest one, 8 bytes
+    MESHOPT_FILTER_QUATERNION,
+    // floats as a shared exponent and a 24-bit mantissa, 4 bytes per component
+    MESHOPT_FILTER_EXPONENTIAL,
+};
+
+// Decoders of the meshoptimizer bitstreams, version 0 as EXT_meshopt_compression
+// specifies. `dst` receives `count` elements of `stride` bytes. False when `src`
+// is malformed or its size does not match, `dst` is then partly written.
+bool decodeVertexBuffer(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size);
+// triangle list, `count` is a multiple of 3, `stride` 2 or 4
+bool decodeIndexBuffer(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size);
+// any other index list, `stride` 2 or 4
+bool decodeIndexSequence(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size);
+// reverses `filter` in place on `count` decoded elements
+void decodeFilter(MeshoptFilter filter, unsigned char *data, size_t count, size_t stride);
+
+// true for a buffer the extension marks as fallback: it may have no uri and its
+// bytes are only valid once the views compressed into it are decoded
+bool isMeshoptFallback(const tinygltf::Buffer &buffer);
+
+// Decodes every bufferView with EXT_meshopt_compression whose buffer is a
+// fallback buffer into that buffer, views are spread over `threads` workers
+// (0 = one per hardware thread). Views of buffers that carry the uncompressed
+// data themselves are left alone.
+bool decodeMeshopt(LoadedModel &loaded, unsigned int threads, std::string &err);
+
+// decodes the compressed views of `filename` `runs` times on one thread and on
+// the pool and prints the throughput of both. Files without compressed views
+// are benchmarked on a synthetic grid mesh encoded here.
+void benchmarkMeshopt(const std::string &filename, const LoadOptions &options, int runs);
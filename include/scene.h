@@ -0,0 +1,148 @@
+#pragma once
+
+#include <glad.h>
+#include "loader.h"
+#include "scene_graph.h"
+#include <algorithm>
+#include <cstdint>
+#include <glm/geometric.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec3.hpp>
+#include <utility>
+#include <vector>
+
+
+struct MaterialTex {
+    // texture ids
+    GLuint emissiveId;
+    GLuint normalId;
+    GLuint occlusionId;
+    GLuint baseColorId;
+    GLuint metallicRoughnessId;
+
+    // sampler object of the base color texture
+    GLuint baseColorSampler;
+    // texcoord transform of the base color texture, from KHR_texture_transform
+    glm::mat3 uvTransform;
+
+    // constant colors
+    glm::vec3 basecolor;
+
+    MaterialTex() : emissiveId(0), normalId(0), occlusionId(0), baseColorId(0), metallicRoughnessId(0),
+                    baseColorSampler(0), uvTransform(1.0f) {}
+};
+
+// attribute of an interleaved vertex, `offset` is relative to the start of the vertex
+struct VertexAttrib {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLuint offset;
+
+    bool operator==(const VertexAttrib &o) const {
+        return location == o.location && size == o.size && type == o.type && normalized == o.normalized
+               && offset == o.offset;
+    }
+};
+
+// attributes and stride of interleaved vertices, draws with the same layout share a VAO
+struct VertexLayout {
+    std::vector<VertexAttrib> attribs;
+    GLsizei stride;
+
+    bool operator==(const VertexLayout &o) const { return stride == o.stride && attribs == o.attribs; }
+};
+
+// one glTF primitive ready to be drawn, `vao` is 0 until createVertexArrays()
+struct DrawItem {
+    GLuint vao;
+    GLenum mode;
+    GLsizei count;
+    GLenum indexType;
+    // byte offset of the first index in `indexBuffer`
+    size_t indexOffset;
+    // index of the first vertex in `vertexBuffer`, added to every index
+    GLint baseVertex;
+    // index into RenderScene::layouts
+    int layout;
+    GLuint indexBuffer;
+    GLuint vertexBuffer;
+    MaterialTex material;
+    // world matrix and the inverse transpose the shader transforms normals with, set both through setModel()
+    glm::mat4 model;
+    glm::mat4 normal;
+    // object-space bounding sphere, radius 0 when POSITION has no bounds
+    glm::vec3 localCenter;
+    float localRadius;
+    // the same sphere in world space, follows the world matrix
+    glm::vec3 center;
+    float radius;
+
+    void setModel(const glm::mat4 &m) {
+        model = m;
+        normal = glm::transpose(glm::inverse(m));
+        center = glm::vec3(m * glm::vec4(localCenter, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])),
+                                                                       glm::length(glm::vec3(m[2]))));
+        radius = localRadius * scale;
+    }
+};
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 color;
+};
+
+// GL objects and draw list of the bound model, the render loop only reads this
+struct RenderScene {
+    std::vector<DrawItem> draws;
+    // node hierarchy the draws hang off, the draws of graph entry e are
+    // entryDraws[e] .. entryDraws[e + 1]
+    SceneGraph graph;
+    std::vector<uint32_t> entryDraws;
+    std::vector<PointLight> lights;
+    std::vector<VertexLayout> layouts;
+    // base color textures whose image is still being decoded: draw index, glTF texture index
+    std::vector<std::pair<size_t, int>> pendingTextures;
+
+    // owned GL objects
+    std::vector<GLuint> vaos;
+    std::vector<GLuint> buffers;
+    // bytes in use at the start of each of `buffers`
+    std::vector<size_t> bufferSizes;
+    std::vector<GLuint> textures;
+    std::vector<GLuint> samplers;
+
+    void release() {
+        glDeleteVertexArrays((GLsizei) vaos.size(), vaos.data());
+        glDeleteBuffers((GLsizei) buffers.size(), buffers.data());
+        glDeleteTextures((GLsizei) textures.size(), textures.data());
+        glDeleteSamplers((GLsizei) samplers.size(), samplers.data());
+        vaos.clear();
+        buffers.clear();
+        bufferSizes.clear();
+        textures.clear();
+        samplers.clear();
+        draws.clear();
+        graph = SceneGraph();
+        entryDraws.clear();
+        lights.clear();
+        layouts.clear();
+        pendingTextures.clear();
+    }
+};
+
+// uploads buffers and textures of the default scene and builds its draw list. Needs
+// a current context but creates no VAOs, so it may run on a shared loader context.
+RenderScene bindModel(LoadedModel &loaded);
+
+// recomputes the world matrices below the graph entries changed since the last
+// call and moves their draws along, nothing to do when no entry changed. Large
+// levels are split over `pool` when there is one.
+void updateTransforms(RenderScene &scene, ThreadPool *pool = nullptr);
+
+// creates the VAOs of every draw, VAOs are not shared so this runs on the render context
+void createVertexArrays(RenderScene &scene);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "loader.h"
+#include "mapped_file.h"
+#include "scene.h"
+#include <cstdint>
+#include <string>
+
+
+// creates `dir` unless it exists, its parent has to exist
+void makeDirectory(const std::string &dir);
+
+// On-disk copy of a bound scene: the draw list, vertex and index data as it is
+// uploaded and every mip level of every texture. The file is named after a hash
+// of the source glTF and remembers size and modification time of the external
+// files the scene was built from, so stale caches are never used. A cache
+// written with other texture options is not used either.
+class SceneCache
+{
+public:
+    // `options` are those of the load the cache stands in for, only the texture options matter
+    SceneCache(const std::string &directory, const std::string &source, const LoadOptions &options);
+
+    // maps the cache of `source`, false when there is none or it is stale
+    bool open();
+    // creates the buffers and textures of `scene` straight from the mapped cache,
+    // VAOs are left to createVertexArrays()
+    bool upload(RenderScene &scene);
+    // stores a freshly bound scene, texture levels are read back from GL
+    bool write(const RenderScene &scene, const LoadedModel &loaded);
+
+    static uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+private:
+    bool hashSource();
+
+    std::string directory;
+    std::string source;
+    std::string path;
+    uint64_t sourceHash = 0;
+    // LoadOptions::compressTextures in bit 0, compressBc7 in bit 1
+    uint32_t textureOptions;
+    MappedFile file;
+    // offset of the scene data behind the header and dependency list
+    size_t bodyOffset = 0;
+};
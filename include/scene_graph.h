@@ -0,0 +1,79 @@
+#pragma once
+
+#include "loader.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <vector>
+
+
+// local matrix of `node`: its `matrix` when it has one, translation * rotation * scale otherwise
+glm::mat4 createModelMatrix(const tinygltf::Node &node);
+
+// Node hierarchy of a scene flattened into arrays. Entries are in breadth-first
+// order, so parents come before their children, the children of an entry are
+// contiguous and so is every level. World matrices are cached; update() only
+// recomputes the subtrees below entries whose local matrix changed, or every
+// level when most of them did.
+class SceneGraph
+{
+public:
+    // translation, rotation and scale of every entry in separate arrays, so
+    // several entries are composed into local matrices at once
+    struct TRS {
+        std::vector<float> tx, ty, tz;
+        // unit quaternion
+        std::vector<float> rx, ry, rz, rw;
+        std::vector<float> sx, sy, sz;
+    };
+
+    // glTF node of each entry
+    std::vector<int> nodes;
+    // parent entry, -1 for roots
+    std::vector<int> parents;
+    // the children of entry e are firstChild[e] .. firstChild[e] + childCount[e]
+    std::vector<uint32_t> firstChild;
+    std::vector<uint32_t> childCount;
+    // first entry of every level, plus the end
+    std::vector<uint32_t> levels;
+    TRS trs;
+    // 1 where the local matrix is given as is (node.matrix, setLocal) instead of composed from `trs`
+    std::vector<char> fixedMatrix;
+    std::vector<glm::mat4> local;
+    std::vector<glm::mat4> world;
+
+    // flattens the nodes reachable from `scene`, or from every node without a
+    // parent when the model has no such scene. Nodes reached twice are skipped.
+    void build(const tinygltf::Model &model, int scene);
+    // derives children, levels and world matrices from `nodes`, `parents` and
+    // `local` alone, false when `parents` is not in breadth-first order. Entries
+    // without TRS keep their local matrix fixed.
+    bool rebuild();
+    size_t size() const { return nodes.size(); }
+
+    // the world matrices of `entry` and below are recomputed by the next update()
+    void setLocal(uint32_t entry, const glm::mat4 &matrix);
+    void setTRS(uint32_t entry, const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale);
+    bool dirty() const { return !dirtyEntries.empty(); }
+    // recomputes the world matrices below the entries changed since the last
+    // update and returns every entry it recomputed, parents first. Nothing is
+    // allocated once the scratch lists have grown to the size of the changes.
+    // When a large share of the entries changed it runs updateAll() instead.
+    const std::vector<uint32_t> &update(ThreadPool *pool = nullptr);
+    // composes every local matrix and recomputes every world matrix, one level
+    // at a time with AVX2 where the CPU has it, large levels split over `pool`
+    void updateAll(ThreadPool *pool = nullptr);
+
+private:
+    std::vector<uint32_t> dirtyEntries;
+    std::vector<char> dirtyFlags;
+    // entries recomputed by the last update
+    std::vector<uint32_t> changed;
+};
+
+// animates every node of a synthetic tree of `nodes` nodes `runs` times and
+// prints how many nodes per second the glm path, each kernel and the pool update
+void benchmarkTransforms(size_t nodes, int runs);
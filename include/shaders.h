@@ -11,11 +11,23 @@ enum ShaderType {
     SCENE, DEPTH
 };
 
+// locations of the uniforms set for every draw, looked up once after linking.
+// -1 for uniforms the program does not have, GL ignores those.
+struct DrawUniforms {
+    GLint mvp;
+    GLint model;
+    GLint normalMatrix;
+    GLint uvTransform;
+    GLint basecolor;
+    GLint textured;
+};
+
 class Shaders
 {
 public:
 	GLuint pid;
     ShaderType type;
+    DrawUniforms uniforms;
 
 	Shaders(ShaderType type, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
 	~Shaders();
@@ -38,6 +50,10 @@ public:
     {
         glUniform3fv(glGetUniformLocation(pid, name.c_str()), 1, &value[0]);
     }
+    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(glGetUniformLocation(pid, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    }
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
         glUniformMatrix4fv(glGetUniformLocation(pid, name.c_str()), 1, GL_FALSE, &mat[0][0]);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glad.h>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+
+// Staging memory for buffer uploads. With GL 4.4 buffer storage it is a
+// persistently mapped ring: callers (any thread) write into it and the GPU
+// copies out with glCopyBufferSubData while later regions are being filled.
+// Fences guard regions the GPU may still read. Without buffer storage (GL 4.1)
+// the ring is plain memory and copies become glBufferSubData calls.
+class StagingRing
+{
+public:
+    struct Region {
+        unsigned char *data;
+        size_t offset;
+    };
+
+    // needs a current context
+    explicit StagingRing(size_t capacity);
+    ~StagingRing();
+
+    StagingRing(const StagingRing &) = delete;
+    StagingRing &operator=(const StagingRing &) = delete;
+
+    // false when `size` bytes do not fit before the regions of the current
+    // batch; fence() the batch and try again. Never fits beyond capacity().
+    bool allocate(size_t size, Region &region);
+    // copies a filled region into `buffer` at `offset`
+    void copy(const Region &region, GLuint buffer, size_t offset, size_t size);
+    // ends the batch, its regions are reused once the GPU has executed its copies
+    void fence();
+    // waits for every copy and prints the throughput
+    void finish();
+
+    size_t capacity() const { return ringCapacity; }
+    bool persistent() const { return buffer != 0; }
+
+private:
+    struct Segment {
+        GLsync fence;
+        size_t begin;
+        size_t end;
+    };
+
+    size_t ringCapacity;
+    GLuint buffer = 0;
+    unsigned char *mapped = nullptr;
+    // stands in for the mapping without buffer storage
+    std::vector<unsigned char> memory;
+
+    size_t head = 0;
+    size_t batchBegin = 0;
+    std::deque<Segment> inFlight;
+
+    size_t copiedBytes = 0;
+    std::chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glad.h>
+#include "tiny_gltf.h"
+#include "loader.h"
+#include "scene.h"
+#include "texture_compress.h"
+#include <map>
+
+
+// pixel transfer format and type of a decoded image
+void pixelFormat(const tinygltf::Image &image, GLenum &format, GLenum &type);
+
+// sized internal format that keeps the channels and bit depth of a decoded image
+GLenum sizedFormat(const tinygltf::Image &image);
+
+// number of levels of a full mip chain
+int mipLevels(int width, int height);
+
+// allocates a full mip chain for the bound GL_TEXTURE_2D, immutable where GL 4.2 is
+// available. `format` and `type` only matter for the GL 4.1 fallback.
+void textureStorage(GLenum internalFormat, GLenum format, GLenum type, int width, int height);
+
+// number of mip levels the bound GL_TEXTURE_2D holds: its immutable levels, or up to
+// GL_TEXTURE_MAX_LEVEL where storage is mutable. A KTX2 chain may stop short of 1x1.
+int textureLevels();
+
+// makes one and two channel textures of the bound GL_TEXTURE_2D sample as grey and grey-alpha
+void applySwizzle(GLenum internalFormat);
+
+// GL internal format of a block format
+GLenum compressedFormat(BlockFormat format);
+
+// true when the context can sample BC1 to BC5, the formats the encoder falls back to; BC4 and BC5 are
+// core, BC1 and BC3 need EXT_texture_compression_s3tc
+bool textureCompressionSupported();
+
+// true when BC7 samples: GL 4.2 or ARB_texture_compression_bptc
+bool bptcSupported();
+
+// one level of a block compressed mip chain
+struct CompressedLevel {
+    const unsigned char *data;
+    size_t size;
+};
+
+// allocates and fills the bound GL_TEXTURE_2D with a block compressed mip chain, level 0 first
+void compressedStorage(GLenum internalFormat, int width, int height, const std::vector<CompressedLevel> &levels);
+
+// texture with every level of a compressed image, no mipmaps are generated
+GLuint createCompressedTexture(const CompressedImage &image, const std::string &name);
+
+// uploads glTF image `imageIndex` with a full mip chain, filtering and wrapping come from a sampler object
+GLuint createTexture(tinygltf::Model &model, int imageIndex);
+
+// sampler object with the state of glTF sampler `sampler`, -1 gives the glTF defaults
+GLuint createSampler(const tinygltf::Model &model, int sampler);
+
+// Textures and sampler objects of one model. Each image is uploaded once however
+// many glTF textures and primitives use it, block compressed when the loader
+// compressed it, and each glTF sampler becomes one GL sampler object. Everything
+// created is owned by the RenderScene passed in.
+class TextureCache
+{
+public:
+    explicit TextureCache(LoadedModel &loaded) : loaded(loaded), model(loaded.model) {}
+
+    // texture and sampler object of glTF texture `texIndex`, created on first use
+    GLuint texture(RenderScene &scene, int texIndex);
+    GLuint sampler(RenderScene &scene, int texIndex);
+
+    int created() const { return createdCount; }
+    // prints how many textures were created and how many requests reused one
+    void printStats() const;
+
+private:
+    LoadedModel &loaded;
+    tinygltf::Model &model;
+    // glTF image -> texture, glTF sampler -> sampler object
+    std::map<int, GLuint> textures;
+    std::map<int, GLuint> samplers;
+
+    int createdCount = 0;
+    int reusedCount = 0;
+    size_t reusedBytes = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "tiny_gltf.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// block compressed formats, all of them code 4x4 texel blocks
+enum BlockFormat : uint32_t {
+    BLOCK_NONE = 0,
+    // RGB, 8 bytes per block
+    BLOCK_BC1,
+    // RGBA, BC1 color plus a BC4 alpha block, 16 bytes
+    BLOCK_BC3,
+    // one channel, 8 bytes
+    BLOCK_BC4,
+    // two channels, two BC4 blocks, 16 bytes
+    BLOCK_BC5,
+    // RGBA, 16 bytes, encoded as mode 6 only
+    BLOCK_BC7,
+    // BC1 with punch-through alpha, 8 bytes, only read from KTX2 files
+    BLOCK_BC1A,
+};
+
+// a block compressed image with its full mip chain, level 0 first
+struct CompressedImage {
+    BlockFormat format = BLOCK_NONE;
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<unsigned char>> levels;
+
+    size_t size() const;
+};
+
+size_t blockBytes(BlockFormat format);
+// bytes of mip level `level` of a width x height image, partial blocks count whole
+size_t levelBytes(BlockFormat format, int width, int height, int level);
+
+// Compresses a decoded 8-bit image: the mip chain is built on the CPU with a box
+// filter and every level is coded with the format its channels call for. RGBA
+// images whose alpha is opaque everywhere become BC1, the others BC3, or BC7
+// (mode 6) with `bc7`. False for 16-bit images, which stay uncompressed.
+bool compressImage(const tinygltf::Image &image, CompressedImage &out, bool bc7 = false);
+
+// Compressed images are cached on disk under a hash of the encoded file, so a
+// warm start skips both the decode and the compression.
+std::string compressedImagePath(const std::string &directory, const unsigned char *encoded, size_t size, bool bc7);
+bool readCompressedImage(const std::string &path, CompressedImage &image);
+bool writeCompressedImage(const std::string &path, const CompressedImage &image);
+
+// compresses every 8-bit image of `filename`, or a synthetic one, `runs` times in
+// each format it could get and prints throughput, size and PSNR per format
+void benchmarkCompress(const std::string &filename, int runs);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "loader.h"
+#include "scene.h"
+#include "thread_pool.h"
+#include <glm/vec3.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+
+// Decodes the images a progressive loadModel() deferred on background threads
+// and streams them into textures on the render thread. Pixels go through a
+// small pool of pixel buffer objects a band of rows at a time, so a frame
+// never spends much more than its budget on a large image. Decoded images are
+// uploaded in order of how much of the screen their draws cover. Until its
+// texture arrives a draw shows its base color factor. Images no draw of the
+// scene waits for are dropped without being decoded.
+class TextureStreamer
+{
+public:
+    // `budgetMs` caps the time upload() spends per frame, `scene` is the one
+    // bindModel() built from `loaded`
+    TextureStreamer(LoadedModel &loaded, const RenderScene &scene, unsigned int threads, double budgetMs);
+    // drops decodes that have not started yet, needs the context for the PBOs
+    ~TextureStreamer();
+
+    // continues the uploads for up to the budget and swaps finished textures into
+    // the waiting draws, returns how many finished. `eye` ranks the images.
+    int upload(RenderScene &scene, const glm::vec3 &eye);
+    // every deferred image has been decoded and uploaded
+    bool finished() const { return remaining == 0; }
+
+private:
+    // the image whose rows are being copied, `row` is the first one not yet sent
+    struct ActiveUpload {
+        size_t image;
+        GLuint texture;
+        int row;
+    };
+
+    float priority(const RenderScene &scene, size_t image, const glm::vec3 &eye) const;
+    // copies the next band of rows of the active image through a PBO, true when it was the last
+    bool uploadBand();
+    void complete(RenderScene &scene, size_t image, GLuint texture);
+
+    LoadedModel &loaded;
+    std::vector<PendingImage> images;
+    std::vector<char> decodedOk;
+    double budgetMs;
+    size_t remaining;
+
+    std::mutex mutex;
+    // indices into `images` that finished decoding, in completion order
+    std::deque<size_t> decoded;
+    std::atomic<bool> cancelled;
+
+    // render thread only: decoded images waiting for upload and the one in flight
+    std::vector<size_t> ready;
+    bool active = false;
+    ActiveUpload current;
+    std::vector<GLuint> pbos;
+    size_t nextPbo = 0;
+    int streamed = 0;
+
+    // destroyed first, so workers are joined while the rest is still alive
+    ThreadPool pool;
+};
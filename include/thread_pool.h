@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+// fixed set of worker threads consuming a FIFO of tasks
+class ThreadPool
+{
+public:
+    // threads == 0 picks one worker per hardware thread
+    explicit ThreadPool(unsigned int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+    // blocks until every submitted task has finished
+    void wait();
+    // runs fn(0) .. fn(count - 1) on the workers and waits for all of them
+    void parallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+    unsigned int size() const { return (unsigned int) workers.size(); }
+
+    static unsigned int defaultThreadCount();
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    std::condition_variable allDone;
+    size_t pending = 0;
+    bool stopping = false;
+};
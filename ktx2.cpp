@@ -0,0 +1,229 @@
+#include "include/ktx2.h"
+#include "include/texture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <zstd.h>
+
+
+namespace {
+
+const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// fixed part of the file behind the identifier, 68 bytes in the file
+struct Ktx2Header {
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+const size_t KTX2_HEADER_SIZE = 13 * 4 + 2 * 8;
+// the largest side read, levels are sized from the header before anything is allocated
+const uint32_t MAX_DIMENSION = 1 << 16;
+
+enum Supercompression : uint32_t {
+    SUPERCOMPRESSION_NONE = 0,
+    SUPERCOMPRESSION_BASISLZ = 1,
+    SUPERCOMPRESSION_ZSTD = 2,
+};
+
+// the header in the file has no padding before the 64-bit fields
+Ktx2Header readHeader(const unsigned char *bytes) {
+    Ktx2Header header;
+    uint32_t fields[13];
+    std::memcpy(fields, bytes, sizeof(fields));
+    header.vkFormat = fields[0];
+    header.typeSize = fields[1];
+    header.pixelWidth = fields[2];
+    header.pixelHeight = fields[3];
+    header.pixelDepth = fields[4];
+    header.layerCount = fields[5];
+    header.faceCount = fields[6];
+    header.levelCount = fields[7];
+    header.supercompressionScheme = fields[8];
+    header.dfdByteOffset = fields[9];
+    header.dfdByteLength = fields[10];
+    header.kvdByteOffset = fields[11];
+    header.kvdByteLength = fields[12];
+    std::memcpy(&header.sgdByteOffset, bytes + sizeof(fields), 8);
+    std::memcpy(&header.sgdByteLength, bytes + sizeof(fields) + 8, 8);
+    return header;
+}
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// VkFormat values the viewer can upload, sRGB variants are read as the shader reads every texture
+BlockFormat blockFormat(uint32_t vkFormat) {
+    switch (vkFormat) {
+    case 131: case 132: return BLOCK_BC1;
+    case 133: case 134: return BLOCK_BC1A;
+    case 137: case 138: return BLOCK_BC3;
+    case 139: return BLOCK_BC4;
+    case 141: return BLOCK_BC5;
+    case 145: case 146: return BLOCK_BC7;
+    default: return BLOCK_NONE;
+    }
+}
+
+// channels of an 8-bit unorm or srgb VkFormat, 0 for anything else
+int pixelChannels(uint32_t vkFormat) {
+    switch (vkFormat) {
+    case 9: case 15: return 1;
+    case 16: case 22: return 2;
+    case 23: case 29: return 3;
+    case 37: case 43: return 4;
+    default: return 0;
+    }
+}
+
+int blockChannels(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC4: return 1;
+    case BLOCK_BC5: return 2;
+    case BLOCK_BC1: return 3;
+    default: return 4;
+    }
+}
+
+// bytes of level `level` once any supercompression is undone, rows and blocks tightly packed
+size_t expectedLevelBytes(BlockFormat format, int channels, int width, int height, int level) {
+    if (format != BLOCK_NONE) return levelBytes(format, width, height, level);
+    return (size_t) std::max(width >> level, 1) * std::max(height >> level, 1) * channels;
+}
+
+// the bytes of `level`, inflated first when the file is Zstandard supercompressed
+bool readLevel(const unsigned char *bytes, const Ktx2Level &level, uint32_t scheme, size_t expected,
+               std::vector<unsigned char> &out, std::string &err) {
+    const unsigned char *data = bytes + level.byteOffset;
+    if (scheme == SUPERCOMPRESSION_NONE) {
+        if (level.byteLength != expected) {
+            err = "KTX2 level holds " + std::to_string(level.byteLength) + " bytes, its size needs " +
+                  std::to_string(expected);
+            return false;
+        }
+        out.assign(data, data + expected);
+        return true;
+    }
+    if (level.uncompressedByteLength != expected) {
+        err = "KTX2 level inflates to " + std::to_string(level.uncompressedByteLength) + " bytes, its size needs " +
+              std::to_string(expected);
+        return false;
+    }
+    out.resize(expected);
+    size_t written = ZSTD_decompress(out.data(), out.size(), data, level.byteLength);
+    if (ZSTD_isError(written) || written != expected) {
+        err = std::string("corrupt Zstandard KTX2 level: ") +
+              (ZSTD_isError(written) ? ZSTD_getErrorName(written) : "short data");
+        return false;
+    }
+    return true;
+}
+
+}
+
+
+bool isKtx2(const unsigned char *bytes, size_t size) {
+    return size >= sizeof(KTX2_IDENTIFIER) && std::memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0;
+}
+
+bool loadKtx2(const unsigned char *bytes, size_t size, tinygltf::Image &image, CompressedImage &blocks,
+              std::string &err) {
+    if (!isKtx2(bytes, size) || size < sizeof(KTX2_IDENTIFIER) + KTX2_HEADER_SIZE) {
+        err = "not a KTX2 file";
+        return false;
+    }
+    Ktx2Header header = readHeader(bytes + sizeof(KTX2_IDENTIFIER));
+
+    if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1) {
+        err = "KTX2 arrays, cube maps and 3D textures are not supported";
+        return false;
+    }
+    if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > MAX_DIMENSION ||
+        header.pixelHeight > MAX_DIMENSION) {
+        err = "KTX2 size " + std::to_string(header.pixelWidth) + "x" + std::to_string(header.pixelHeight) +
+              " is out of range";
+        return false;
+    }
+    BlockFormat format = blockFormat(header.vkFormat);
+    int channels = pixelChannels(header.vkFormat);
+    // BasisLZ is always ETC1S, and vkFormat 0 under Zstandard is UASTC, both only a Basis Universal transcoder reads
+    if (header.supercompressionScheme == SUPERCOMPRESSION_BASISLZ || header.vkFormat == 0) {
+        err = "Basis Universal KTX2 (ETC1S or UASTC) needs a transcoder the viewer does not include";
+        return false;
+    }
+    if (header.supercompressionScheme != SUPERCOMPRESSION_NONE &&
+        header.supercompressionScheme != SUPERCOMPRESSION_ZSTD) {
+        err = "unsupported KTX2 supercompression scheme " + std::to_string(header.supercompressionScheme);
+        return false;
+    }
+    if (format == BLOCK_NONE && channels == 0) {
+        err = "unsupported KTX2 VkFormat " + std::to_string(header.vkFormat);
+        return false;
+    }
+
+    // levelCount 0 asks the reader to generate mipmaps, the file holds level 0 only
+    uint32_t levelCount = header.levelCount > 0 ? header.levelCount : 1;
+    int width = (int) header.pixelWidth, height = (int) header.pixelHeight;
+    if (levelCount > (uint32_t) mipLevels(width, height)) {
+        err = "KTX2 has " + std::to_string(levelCount) + " levels, a " + std::to_string(width) + "x" +
+              std::to_string(height) + " image has at most " + std::to_string(mipLevels(width, height));
+        return false;
+    }
+    size_t indexOffset = sizeof(KTX2_IDENTIFIER) + KTX2_HEADER_SIZE;
+    if ((size - indexOffset) / sizeof(Ktx2Level) < levelCount) {
+        err = "truncated KTX2 level index";
+        return false;
+    }
+
+    std::vector<Ktx2Level> levels(levelCount);
+    std::memcpy(levels.data(), bytes + indexOffset, levelCount * sizeof(Ktx2Level));
+    for (const Ktx2Level &level : levels) {
+        if (level.byteOffset > size || level.byteLength > size - level.byteOffset) {
+            err = "truncated KTX2 level data";
+            return false;
+        }
+    }
+
+    image.width = (int) header.pixelWidth;
+    image.height = (int) header.pixelHeight;
+    image.bits = 8;
+    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+
+    if (format != BLOCK_NONE) {
+        image.component = blockChannels(format);
+        blocks.format = format;
+        blocks.width = image.width;
+        blocks.height = image.height;
+        blocks.levels.resize(levelCount);
+        for (uint32_t i = 0; i < levelCount; ++i) {
+            size_t expected = expectedLevelBytes(format, 0, width, height, (int) i);
+            if (!readLevel(bytes, levels[i], header.supercompressionScheme, expected, blocks.levels[i], err)) {
+                blocks = CompressedImage();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // further uncompressed levels are generated on upload
+    image.component = channels;
+    return readLevel(bytes, levels[0], header.supercompressionScheme,
+                     expectedLevelBytes(format, channels, width, height, 0), image.image, err);
+}
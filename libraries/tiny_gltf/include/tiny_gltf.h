@@ -261,9 +261,17 @@ static inline int32_t GetNumComponentsInType(uint32_t ty) {
 
 // TODO(syoyo): Move these functions to TinyGLTF class
 bool IsDataURI(const std::string &in);
+// Decodes %XX escapes of a relative uri the way the loader does before opening it.
+std::string DecodeURI(const std::string &uri);
 bool DecodeDataURI(std::vector<unsigned char> *out, std::string &mime_type,
                    const std::string &in, size_t reqBytes, bool checkSize);
 
+// Decodes `size` base64 characters at `in` into `out`, false on invalid input.
+// DecodeDataURI uses the built-in base64_decode until one is installed.
+typedef bool (*Base64DecodeFunction)(const char *in, size_t size,
+                                     std::vector<unsigned char> *out);
+void SetBase64Decoder(Base64DecodeFunction decoder);
+
 #ifdef __clang__
 #pragma clang diagnostic push
 // Suppress warning for : static Value null_value
@@ -1069,6 +1077,10 @@ class Node {
 struct Buffer {
   std::string name;
   std::vector<unsigned char> data;
+  // Set instead of `data` when a MapBufferDataFunction handed out the payload.
+  // The bytes are owned by the application and `data` stays empty.
+  const unsigned char *mapped_data{nullptr};
+  size_t mapped_size{0};
   std::string
       uri;  // considered as required here but not in the spec (need to clarify)
             // uri is not decoded(e.g. whitespace may be represented as %20)
@@ -1202,6 +1214,19 @@ enum SectionCheck {
   REQUIRE_ALL = 0x7f
 };
 
+///
+/// LoadImageDataOption struct.
+/// This struct is passed through `user_pointer` in LoadImageData.
+/// The struct is not passed when the user supply their own LoadImageData
+/// callbacks, which may pass it when they call LoadImageData themselves.
+///
+struct LoadImageDataOption {
+  // true: preserve image channels(e.g. load as RGB image if the image has RGB
+  // channels) default `false`(channels are expanded to RGBA for backward
+  // compatibility).
+  bool preserve_channels{false};
+};
+
 ///
 /// LoadImageDataFunction type. Signature for custom image loading callbacks.
 ///
@@ -1210,6 +1235,17 @@ typedef bool (*LoadImageDataFunction)(Image *, const int, std::string *,
                                       const unsigned char *, int,
                                       void *user_pointer);
 
+///
+/// MapBufferDataFunction type. Signature for callbacks that hand out the
+/// payload of a buffer instead of having it copied into Buffer::data.
+/// `bin_data` is the BIN chunk of a .glb, nullptr for the external file at
+/// `filepath`. Returns `byte_length` bytes which have to outlive the Model,
+/// or nullptr to have the buffer loaded as usual.
+///
+typedef const unsigned char *(*MapBufferDataFunction)(
+    const std::string &filepath, const unsigned char *bin_data,
+    size_t byte_length, std::string *err, void *user_pointer);
+
 ///
 /// WriteImageDataFunction type. Signature for custom image writing callbacks.
 ///
@@ -1373,6 +1409,12 @@ class TinyGLTF {
   ///
   void RemoveImageLoader();
 
+  ///
+  /// Set callback that maps buffer payloads instead of copying them, see
+  /// MapBufferDataFunction. Buffers it maps have Buffer::mapped_data set.
+  ///
+  void SetBufferMapper(MapBufferDataFunction MapBufferData, void *user_data);
+
   ///
   /// Set callback to use for writing image data
   ///
@@ -1469,6 +1511,9 @@ class TinyGLTF {
   void *load_image_user_data_{nullptr};
   bool user_image_loader_{false};
 
+  MapBufferDataFunction MapBufferData{nullptr};
+  void *map_buffer_user_data_{nullptr};
+
   WriteImageDataFunction WriteImageData =
 #ifndef TINYGLTF_NO_STB_IMAGE_WRITE
       &tinygltf::WriteImageData;
@@ -1735,19 +1780,6 @@ void JsonParse(JsonDocument &doc, const char *str, size_t length,
 
 namespace tinygltf {
 
-///
-/// Internal LoadImageDataOption struct.
-/// This struct is passed through `user_pointer` in LoadImageData.
-/// The struct is not passed when the user supply their own LoadImageData
-/// callbacks.
-///
-struct LoadImageDataOption {
-  // true: preserve image channels(e.g. load as RGB image if the image has RGB
-  // channels) default `false`(channels are expanded to RGBA for backward
-  // compatibility).
-  bool preserve_channels{false};
-};
-
 // Equals function for Value, for recursivity
 static bool Equals(const tinygltf::Value &one, const tinygltf::Value &other) {
   if (one.Type() != other.Type()) return false;
@@ -1835,7 +1867,9 @@ bool Asset::operator==(const Asset &other) const {
          this->minVersion == other.minVersion && this->version == other.version;
 }
 bool Buffer::operator==(const Buffer &other) const {
-  return this->data == other.data && this->extensions == other.extensions &&
+  return this->data == other.data && this->mapped_data == other.mapped_data &&
+         this->mapped_size == other.mapped_size &&
+         this->extensions == other.extensions &&
          this->extras == other.extras && this->name == other.name &&
          this->uri == other.uri;
 }
@@ -2355,6 +2389,11 @@ void TinyGLTF::SetImageLoader(LoadImageDataFunction func, void *user_data) {
   user_image_loader_ = true;
 }
 
+void TinyGLTF::SetBufferMapper(MapBufferDataFunction func, void *user_data) {
+  MapBufferData = func;
+  map_buffer_user_data_ = user_data;
+}
+
 void TinyGLTF::RemoveImageLoader() {
   LoadImageData =
 #ifndef TINYGLTF_NO_STB_IMAGE
@@ -2854,6 +2893,8 @@ static void UpdateImageObject(Image &image, std::string &baseDir, int index,
   }
 }
 
+std::string DecodeURI(const std::string &uri) { return dlib::urldecode(uri); }
+
 bool IsDataURI(const std::string &in) {
   std::string header = "data:application/octet-stream;base64,";
   if (in.find(header) == 0) {
@@ -2893,8 +2934,46 @@ bool IsDataURI(const std::string &in) {
   return false;
 }
 
+static Base64DecodeFunction g_base64_decoder = nullptr;
+
+void SetBase64Decoder(Base64DecodeFunction decoder) {
+  g_base64_decoder = decoder;
+}
+
+// DecodeDataURI with an installed decoder, which writes straight into `out`
+static bool DecodeDataURIWith(Base64DecodeFunction decoder,
+                              std::vector<unsigned char> *out,
+                              std::string &mime_type, const std::string &in,
+                              size_t reqBytes, bool checkSize) {
+  static const char *const headers[][2] = {
+      {"data:application/octet-stream;base64,", ""},
+      {"data:image/jpeg;base64,", "image/jpeg"},
+      {"data:image/png;base64,", "image/png"},
+      {"data:image/bmp;base64,", "image/bmp"},
+      {"data:image/gif;base64,", "image/gif"},
+      {"data:text/plain;base64,", "text/plain"},
+      {"data:application/gltf-buffer;base64,", ""}};
+
+  for (const auto &header : headers) {
+    size_t length = strlen(header[0]);
+    if (in.compare(0, length, header[0]) != 0) continue;
+
+    if (!decoder(in.data() + length, in.size() - length, out)) return false;
+    if (header[1][0] != '\0') mime_type = header[1];
+    // TODO(syoyo): Allow empty buffer? #229
+    if (out->empty()) return false;
+    return !checkSize || out->size() == reqBytes;
+  }
+  return false;
+}
+
 bool DecodeDataURI(std::vector<unsigned char> *out, std::string &mime_type,
                    const std::string &in, size_t reqBytes, bool checkSize) {
+  if (g_base64_decoder) {
+    return DecodeDataURIWith(g_base64_decoder, out, mime_type, in, reqBytes,
+                             checkSize);
+  }
+
   std::string header = "data:application/octet-stream;base64,";
   std::string data;
   if (in.find(header) == 0) {
@@ -4057,12 +4136,41 @@ static bool ParseOcclusionTextureInfo(
   return true;
 }
 
+// Asks `map_buffer` for the payload of an external buffer, false when the
+// buffer has to be read through the FS callbacks.
+static bool MapExternalBuffer(Buffer *buffer, std::string *err,
+                              const std::string &filename,
+                              const std::string &basedir, size_t byteLength,
+                              FsCallbacks *fs, MapBufferDataFunction map_buffer,
+                              void *map_buffer_user_data) {
+  if (map_buffer == nullptr || fs == nullptr || fs->FileExists == nullptr ||
+      fs->ExpandFilePath == nullptr) {
+    return false;
+  }
+
+  std::vector<std::string> paths;
+  paths.push_back(basedir);
+  paths.push_back(".");
+
+  std::string filepath = FindFile(paths, filename, fs);
+  if (filepath.empty() || filename.empty()) {
+    return false;
+  }
+
+  buffer->mapped_data =
+      map_buffer(filepath, nullptr, byteLength, err, map_buffer_user_data);
+  buffer->mapped_size = buffer->mapped_data ? byteLength : 0;
+  return buffer->mapped_data != nullptr;
+}
+
 static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
                         bool store_original_json_for_extras_and_extensions,
                         FsCallbacks *fs, const std::string &basedir,
                         bool is_binary = false,
                         const unsigned char *bin_data = nullptr,
-                        size_t bin_size = 0) {
+                        size_t bin_size = 0,
+                        MapBufferDataFunction map_buffer = nullptr,
+                        void *map_buffer_user_data = nullptr) {
   size_t byteLength;
   if (!ParseUnsignedProperty(&byteLength, err, o, "byteLength", true,
                              "Buffer")) {
@@ -4073,90 +4181,119 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
   buffer->uri.clear();
   ParseStringProperty(&buffer->uri, err, o, "uri", false, "Buffer");
 
-  // having an empty uri for a non embedded image should not be valid
-  if (!is_binary && buffer->uri.empty()) {
-    if (err) {
-      (*err) += "'uri' is missing from non binary glTF file buffer.\n";
+  // EXT_meshopt_compression: a fallback buffer without uri holds no data, the
+  // application decodes the compressed bufferViews into it
+  bool meshopt_fallback = false;
+  {
+    json_const_iterator ext_it, meshopt_it;
+    if (FindMember(o, "extensions", ext_it) &&
+        FindMember(GetValue(ext_it), "EXT_meshopt_compression", meshopt_it)) {
+      ParseBooleanProperty(&meshopt_fallback, nullptr, GetValue(meshopt_it),
+                           "fallback", false);
     }
   }
 
-  json_const_iterator type;
-  if (FindMember(o, "type", type)) {
-    std::string typeStr;
-    if (GetString(GetValue(type), typeStr)) {
-      if (typeStr.compare("arraybuffer") == 0) {
-        // buffer.type = "arraybuffer";
+  if (meshopt_fallback && buffer->uri.empty()) {
+    buffer->data.assign(static_cast<size_t>(byteLength), 0);
+  } else {
+    // having an empty uri for a non embedded image should not be valid
+    if (!is_binary && buffer->uri.empty()) {
+      if (err) {
+        (*err) += "'uri' is missing from non binary glTF file buffer.\n";
       }
     }
-  }
 
-  if (is_binary) {
-    // Still binary glTF accepts external dataURI.
-    if (!buffer->uri.empty()) {
-      // First try embedded data URI.
+    json_const_iterator type;
+    if (FindMember(o, "type", type)) {
+      std::string typeStr;
+      if (GetString(GetValue(type), typeStr)) {
+        if (typeStr.compare("arraybuffer") == 0) {
+          // buffer.type = "arraybuffer";
+        }
+      }
+    }
+
+    if (is_binary) {
+      // Still binary glTF accepts external dataURI.
+      if (!buffer->uri.empty()) {
+        // First try embedded data URI.
+        if (IsDataURI(buffer->uri)) {
+          std::string mime_type;
+          if (!DecodeDataURI(&buffer->data, mime_type, buffer->uri, byteLength,
+                             true)) {
+            if (err) {
+              (*err) +=
+                  "Failed to decode 'uri' : " + buffer->uri + " in Buffer\n";
+            }
+            return false;
+          }
+        } else {
+          // External .bin file.
+          std::string decoded_uri = dlib::urldecode(buffer->uri);
+          if (!MapExternalBuffer(buffer, err, decoded_uri, basedir, byteLength,
+                                 fs, map_buffer, map_buffer_user_data) &&
+              !LoadExternalFile(&buffer->data, err, /* warn */ nullptr,
+                                decoded_uri, basedir, /* required */ true,
+                                byteLength, /* checkSize */ true, fs)) {
+            return false;
+          }
+        }
+      } else {
+        // load data from (embedded) binary data
+
+        if ((bin_size == 0) || (bin_data == nullptr)) {
+          if (err) {
+            (*err) += "Invalid binary data in `Buffer', or GLB with empty BIN chunk.\n";
+          }
+          return false;
+        }
+
+        if (byteLength > bin_size) {
+          if (err) {
+            std::stringstream ss;
+            ss << "Invalid `byteLength'. Must be equal or less than binary size: "
+                  "`byteLength' = "
+               << byteLength << ", binary size = " << bin_size << std::endl;
+            (*err) += ss.str();
+          }
+          return false;
+        }
+
+        if (map_buffer) {
+          buffer->mapped_data = map_buffer(std::string(), bin_data, byteLength,
+                                           err, map_buffer_user_data);
+          buffer->mapped_size = buffer->mapped_data ? byteLength : 0;
+        }
+
+        // Read buffer data
+        if (buffer->mapped_data == nullptr) {
+          buffer->data.resize(static_cast<size_t>(byteLength));
+          memcpy(&(buffer->data.at(0)), bin_data,
+                 static_cast<size_t>(byteLength));
+        }
+      }
+
+    } else {
       if (IsDataURI(buffer->uri)) {
         std::string mime_type;
         if (!DecodeDataURI(&buffer->data, mime_type, buffer->uri, byteLength,
                            true)) {
           if (err) {
-            (*err) +=
-                "Failed to decode 'uri' : " + buffer->uri + " in Buffer\n";
+            (*err) += "Failed to decode 'uri' : " + buffer->uri + " in Buffer\n";
           }
           return false;
         }
       } else {
-        // External .bin file.
+        // Assume external .bin file.
         std::string decoded_uri = dlib::urldecode(buffer->uri);
-        if (!LoadExternalFile(&buffer->data, err, /* warn */ nullptr,
+        if (!MapExternalBuffer(buffer, err, decoded_uri, basedir, byteLength,
+                               fs, map_buffer, map_buffer_user_data) &&
+            !LoadExternalFile(&buffer->data, err, /* warn */ nullptr,
                               decoded_uri, basedir, /* required */ true,
                               byteLength, /* checkSize */ true, fs)) {
           return false;
         }
       }
-    } else {
-      // load data from (embedded) binary data
-
-      if ((bin_size == 0) || (bin_data == nullptr)) {
-        if (err) {
-          (*err) += "Invalid binary data in `Buffer', or GLB with empty BIN chunk.\n";
-        }
-        return false;
-      }
-
-      if (byteLength > bin_size) {
-        if (err) {
-          std::stringstream ss;
-          ss << "Invalid `byteLength'. Must be equal or less than binary size: "
-                "`byteLength' = "
-             << byteLength << ", binary size = " << bin_size << std::endl;
-          (*err) += ss.str();
-        }
-        return false;
-      }
-
-      // Read buffer data
-      buffer->data.resize(static_cast<size_t>(byteLength));
-      memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
-    }
-
-  } else {
-    if (IsDataURI(buffer->uri)) {
-      std::string mime_type;
-      if (!DecodeDataURI(&buffer->data, mime_type, buffer->uri, byteLength,
-                         true)) {
-        if (err) {
-          (*err) += "Failed to decode 'uri' : " + buffer->uri + " in Buffer\n";
-        }
-        return false;
-      }
-    } else {
-      // Assume external .bin file.
-      std::string decoded_uri = dlib::urldecode(buffer->uri);
-      if (!LoadExternalFile(&buffer->data, err, /* warn */ nullptr, decoded_uri,
-                            basedir, /* required */ true, byteLength,
-                            /* checkSize */ true, fs)) {
-        return false;
-      }
     }
   }
 
@@ -5694,7 +5831,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
       Buffer buffer;
       if (!ParseBuffer(&buffer, err, o,
                        store_original_json_for_extras_and_extensions_, &fs,
-                       base_dir, is_binary_, bin_data_, bin_size_)) {
+                       base_dir, is_binary_, bin_data_, bin_size_,
+                       MapBufferData, map_buffer_user_data_)) {
         return false;
       }
 
@@ -5993,6 +6131,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
           return false;
         }
         const Buffer &buffer = model->buffers[size_t(bufferView.buffer)];
+        const unsigned char *buffer_data =
+            buffer.mapped_data ? buffer.mapped_data : buffer.data.data();
 
         if (*LoadImageData == nullptr) {
           if (err) {
@@ -6002,7 +6142,7 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
         }
         bool ret = LoadImageData(
             &image, idx, err, warn, image.width, image.height,
-            &buffer.data[bufferView.byteOffset],
+            buffer_data + bufferView.byteOffset,
             static_cast<int>(bufferView.byteLength), load_image_user_data);
         if (!ret) {
           return false;
@@ -0,0 +1,333 @@
+#include "include/load_report.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+
+
+namespace {
+
+std::atomic<size_t> allocationCounter(0);
+std::atomic<size_t> allocatedCounter(0);
+
+struct StageTotals {
+    std::string name;
+    int calls = 0;
+    double ms = 0.0;
+    size_t allocations = 0;
+    size_t allocatedBytes = 0;
+};
+
+struct AssetTotals {
+    std::string kind;
+    std::string name;
+    size_t read = 0;
+    size_t encoded = 0;
+    size_t decoded = 0;
+    size_t uploaded = 0;
+    double ms = 0.0;
+};
+
+// both lists keep the order things were first seen in
+struct Report {
+    std::mutex mutex;
+    std::vector<StageTotals> stages;
+    std::map<std::string, size_t> stageIndex;
+    std::vector<AssetTotals> assets;
+    std::map<std::pair<std::string, std::string>, size_t> assetIndex;
+
+    StageTotals &stage(const std::string &name) {
+        auto found = stageIndex.find(name);
+        if (found != stageIndex.end()) return stages[found->second];
+        stageIndex[name] = stages.size();
+        stages.push_back(StageTotals());
+        stages.back().name = name;
+        return stages.back();
+    }
+
+    AssetTotals &asset(const std::string &kind, const std::string &name) {
+        auto key = std::make_pair(kind, name);
+        auto found = assetIndex.find(key);
+        if (found != assetIndex.end()) return assets[found->second];
+        assetIndex[key] = assets.size();
+        assets.push_back(AssetTotals());
+        assets.back().kind = kind;
+        assets.back().name = name;
+        return assets.back();
+    }
+};
+
+// constructed on first use, operator new may run before static initialisation is done
+Report &report() {
+    static Report *instance = new Report();
+    return *instance;
+}
+
+double toMB(size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+std::string jsonString(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+}
+
+
+// Every heap allocation of the process is counted, a relaxed increment is all it
+// costs. All replaced operators go through these two, which are kept out of line
+// so the compiler never pairs an inlined malloc or free with a new expression.
+namespace {
+
+__attribute__((noinline)) void *countedAlloc(size_t size, size_t alignment) {
+    allocationCounter.fetch_add(1, std::memory_order_relaxed);
+    allocatedCounter.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void *p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+#endif
+}
+
+__attribute__((noinline)) void countedFree(void *p, size_t alignment) noexcept {
+#ifdef _WIN32
+    if (alignment > alignof(std::max_align_t)) {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void) alignment;
+#endif
+    std::free(p);
+}
+
+void *countedNew(size_t size, size_t alignment) {
+    if (void *p = countedAlloc(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+
+}
+
+void *operator new(size_t size) {
+    return countedNew(size, 0);
+}
+
+void *operator new[](size_t size) {
+    return countedNew(size, 0);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, 0);
+}
+
+void operator delete(void *p) noexcept {
+    countedFree(p, 0);
+}
+
+void operator delete[](void *p) noexcept {
+    countedFree(p, 0);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    countedFree(p, 0);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    countedFree(p, 0);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    countedFree(p, 0);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    countedFree(p, 0);
+}
+
+#ifdef __cpp_aligned_new
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    return countedNew(size, (size_t) alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return countedNew(size, (size_t) alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, (size_t) alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return countedAlloc(size, (size_t) alignment);
+}
+
+void operator delete(void *p, std::align_val_t alignment) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+void operator delete[](void *p, std::align_val_t alignment) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+void operator delete(void *p, size_t, std::align_val_t alignment) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t alignment) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+void operator delete(void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+void operator delete[](void *p, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    countedFree(p, (size_t) alignment);
+}
+
+#endif
+
+
+namespace loadreport {
+
+Stage::Stage(const char *name)
+    : name(name), start(std::chrono::steady_clock::now()),
+      allocations(allocationCount()), allocatedBytes(loadreport::allocatedBytes())
+{
+}
+
+Stage::~Stage()
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    // allocations of every thread, parallel stages see their workers'
+    size_t count = allocationCount() - allocations;
+    size_t bytes = loadreport::allocatedBytes() - allocatedBytes;
+
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    StageTotals &stage = r.stage(name);
+    stage.calls++;
+    stage.ms += ms;
+    stage.allocations += count;
+    stage.allocatedBytes += bytes;
+}
+
+void addRead(const std::string &name, size_t bytes) {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.asset("file", name).read += bytes;
+}
+
+void addDecoded(const std::string &name, size_t encodedBytes, size_t decodedBytes, double ms) {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    AssetTotals &asset = r.asset("image", name);
+    asset.encoded += encodedBytes;
+    asset.decoded += decodedBytes;
+    asset.ms += ms;
+}
+
+void addUploaded(const char *kind, const std::string &name, size_t bytes, double ms) {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    AssetTotals &asset = r.asset(kind, name);
+    asset.uploaded += bytes;
+    asset.ms += ms;
+}
+
+size_t allocationCount() {
+    return allocationCounter.load(std::memory_order_relaxed);
+}
+
+size_t allocatedBytes() {
+    return allocatedCounter.load(std::memory_order_relaxed);
+}
+
+void print(std::ostream &out) {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    out << "load report" << std::endl;
+    for (const StageTotals &stage : r.stages) {
+        out << "  " << stage.name << ": " << stage.ms << " ms";
+        if (stage.calls > 1) out << " in " << stage.calls << " calls";
+        out << ", " << stage.allocations << " allocations (" << toMB(stage.allocatedBytes) << " MB)" << std::endl;
+    }
+
+    size_t read = 0, decoded = 0, uploaded = 0;
+    for (const AssetTotals &asset : r.assets) {
+        out << "  " << asset.kind << " " << asset.name << ":";
+        if (asset.read) out << " read " << toMB(asset.read) << " MB";
+        if (asset.encoded) out << " encoded " << toMB(asset.encoded) << " MB";
+        if (asset.decoded) out << " decoded " << toMB(asset.decoded) << " MB";
+        if (asset.uploaded) out << " uploaded " << toMB(asset.uploaded) << " MB";
+        if (asset.ms > 0.0) out << " in " << asset.ms << " ms";
+        out << std::endl;
+        read += asset.read;
+        decoded += asset.decoded;
+        uploaded += asset.uploaded;
+    }
+    out << "  total: read " << toMB(read) << " MB, decoded " << toMB(decoded) << " MB, uploaded "
+        << toMB(uploaded) << " MB" << std::endl;
+}
+
+void printJson(std::ostream &out) {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    out << "{\n  \"stages\": [";
+    for (size_t i = 0; i < r.stages.size(); ++i) {
+        const StageTotals &stage = r.stages[i];
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(stage.name)
+            << ", \"calls\": " << stage.calls << ", \"ms\": " << stage.ms
+            << ", \"allocations\": " << stage.allocations
+            << ", \"allocated_bytes\": " << stage.allocatedBytes << "}";
+    }
+    out << "\n  ],\n  \"assets\": [";
+    for (size_t i = 0; i < r.assets.size(); ++i) {
+        const AssetTotals &asset = r.assets[i];
+        out << (i ? ",\n" : "\n") << "    {\"kind\": " << jsonString(asset.kind)
+            << ", \"name\": " << jsonString(asset.name)
+            << ", \"bytes_read\": " << asset.read << ", \"bytes_encoded\": " << asset.encoded
+            << ", \"bytes_decoded\": " << asset.decoded << ", \"bytes_uploaded\": " << asset.uploaded
+            << ", \"ms\": " << asset.ms << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+void reset() {
+    Report &r = report();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.stages.clear();
+    r.stageIndex.clear();
+    r.assets.clear();
+    r.assetIndex.clear();
+}
+
+}
@@ -0,0 +1,500 @@
+#include "include/loader.h"
+#include "include/base64.h"
+#include "include/ktx2.h"
+#include "include/load_report.h"
+#include "include/meshopt_decode.h"
+#include "include/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+
+namespace {
+
+// decodes the deferred images into model.images on a worker pool and joins
+bool decodeImages(LoadedModel &loaded, std::vector<PendingImage> &pending, unsigned int threads,
+                  std::string &err, std::string &warn) {
+    loadreport::Stage stage("decode images");
+    std::vector<std::string> errs(pending.size());
+    std::vector<std::string> warns(pending.size());
+    std::vector<char> decoded(pending.size(), 0);
+
+    ThreadPool pool(threads);
+    pool.parallelFor(pending.size(), [&](size_t i) {
+        // every job writes a distinct element of model.images
+        decoded[i] = prepareImage(loaded, pending[i], errs[i], warns[i]);
+    });
+
+    bool ok = true;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        err += errs[i];
+        warn += warns[i];
+        ok = ok && decoded[i];
+    }
+    return ok;
+}
+
+// user data of the mmap file system callbacks
+struct MappedFs {
+    // external buffers by path, adopted by the LoadedModel once parsing is done
+    std::map<std::string, MappedFile> buffers;
+    // set when the BIN chunk of the .glb was handed to tinygltf
+    bool binMapped = false;
+};
+
+// ReadWholeFileFunction reading through a sequential mmap, only external images
+// still go through it, tinygltf wants their bytes in a vector
+bool readMappedFile(std::vector<unsigned char> *out, std::string *err, const std::string &path, void *) {
+    MappedFile file;
+    if (!file.open(path, err)) return false;
+    file.adviseSequential();
+
+    // the mapping saves the read() calls and the zero-fill
+    out->assign(file.data(), file.data() + file.size());
+    loadreport::addRead(path, file.size());
+    return true;
+}
+
+// MapBufferDataFunction, hands tinygltf the BIN chunk or a mapping of the
+// external file so Buffer::data never holds a copy. userData is a MappedFs
+const unsigned char *mapBufferData(const std::string &path, const unsigned char *bin, size_t byteLength,
+                                   std::string *err, void *userData) {
+    auto *fs = static_cast<MappedFs *>(userData);
+    if (bin) {
+        fs->binMapped = true;
+        return bin;
+    }
+
+    auto found = fs->buffers.find(path);
+    if (found == fs->buffers.end()) {
+        MappedFile file;
+        if (!file.open(path, err)) return nullptr;
+        // a size mismatch is left to tinygltf's own read, which reports it
+        if (file.size() != byteLength) return nullptr;
+        file.adviseSequential();
+        loadreport::addRead(path, file.size());
+        found = fs->buffers.emplace(path, std::move(file)).first;
+    }
+    return found->second.size() == byteLength ? found->second.data() : nullptr;
+}
+
+// ReadWholeFileFunction of --no-mmap, tinygltf's ifstream read plus the load report
+bool readCountedFile(std::vector<unsigned char> *out, std::string *err, const std::string &path, void *userData) {
+    if (!tinygltf::ReadWholeFile(out, err, path, userData)) return false;
+    loadreport::addRead(path, out->size());
+    return true;
+}
+
+std::string baseDirectory(const std::string &filename) {
+    size_t slash = filename.find_last_of("/\\");
+    return slash == std::string::npos ? "" : filename.substr(0, slash);
+}
+
+bool isBinaryGltf(const MappedFile &file) {
+    return file.size() >= 20 && std::memcmp(file.data(), "glTF", 4) == 0;
+}
+
+
+// runs tinygltf on the mapped file, external files are read through its FsCallbacks
+bool parse(tinygltf::TinyGLTF &loader, tinygltf::Model &model, const MappedFile &file, bool binary,
+           const std::string &baseDir, std::string &err, std::string &warn) {
+    loadreport::Stage stage("parse");
+    if (binary) {
+        return loader.LoadBinaryFromMemory(&model, &err, &warn, file.data(),
+                                           static_cast<unsigned int>(file.size()), baseDir);
+    }
+    return loader.LoadASCIIFromString(&model, &err, &warn, reinterpret_cast<const char *>(file.data()),
+                                      static_cast<unsigned int>(file.size()), baseDir);
+}
+
+// points every buffer at its payload: the mapping tinygltf was handed, or
+// Buffer::data for data URIs, meshopt fallbacks and --no-mmap loads. The
+// mappings move into the LoadedModel, moving keeps their address.
+void resolveBuffers(LoadedModel &loaded, MappedFile &glb, MappedFs &fs) {
+    if (fs.binMapped) {
+        loaded.files.push_back(std::move(glb));
+    }
+    for (auto &file : fs.buffers) {
+        loaded.files.push_back(std::move(file.second));
+    }
+    fs.buffers.clear();
+
+    loaded.bufferData.clear();
+    loaded.bufferSizes.clear();
+    for (const auto &buffer : loaded.model.buffers) {
+        if (buffer.mapped_data) {
+            loaded.bufferData.push_back(buffer.mapped_data);
+            loaded.bufferSizes.push_back(buffer.mapped_size);
+        } else {
+            loaded.bufferData.push_back(buffer.data.data());
+            loaded.bufferSizes.push_back(buffer.data.size());
+        }
+    }
+}
+
+// KHR_draco_mesh_compression is not decoded: a file that requires it fails,
+// one that only uses it is drawn from its uncompressed data
+bool checkDraco(const tinygltf::Model &model, std::string &err, std::string &warn) {
+    const std::string extension = "KHR_draco_mesh_compression";
+    const std::vector<std::string> &required = model.extensionsRequired;
+    if (std::find(required.begin(), required.end(), extension) != required.end()) {
+        err += extension + " is required but not supported\n";
+        return false;
+    }
+    for (const tinygltf::Mesh &mesh : model.meshes) {
+        for (const tinygltf::Primitive &primitive : mesh.primitives) {
+            if (primitive.extensions.count(extension)) {
+                warn += extension + " is not supported, drawing the uncompressed data\n";
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+// minor and major page faults of this process so far
+void pageFaults(long &minor, long &major) {
+    minor = major = 0;
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        minor = usage.ru_minflt;
+        major = usage.ru_majflt;
+    }
+#endif
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// user data of captureImageData
+struct ImageCapture {
+    // copy the encoded bytes for decodeImages() or the TextureStreamer instead of decoding
+    bool defer = false;
+    std::vector<PendingImage> pending;
+    // blocks of the KTX2 images, by image index
+    std::map<int, CompressedImage> blocks;
+};
+
+// LoadImageDataFunction, userData is an ImageCapture. KTX2 files are read right
+// away, they need no decoding; other images are decoded or deferred.
+bool captureImageData(tinygltf::Image *image, const int imageIdx, std::string *err, std::string *warn,
+                      int reqWidth, int reqHeight, const unsigned char *bytes, int size, void *userData) {
+    auto *capture = static_cast<ImageCapture *>(userData);
+
+    if (isKtx2(bytes, (size_t) size)) {
+        auto start = std::chrono::steady_clock::now();
+        CompressedImage blocks;
+        std::string ktxErr;
+        if (!loadKtx2(bytes, (size_t) size, *image, blocks, ktxErr)) {
+            // not fatal, a texture with KHR_texture_basisu still has its fallback source
+            (*warn) += "image[" + std::to_string(imageIdx) + "]: " + ktxErr + "\n";
+            return true;
+        }
+        loadreport::addDecoded(assetName(*image, imageIdx), (size_t) size, image->image.size() + blocks.size(),
+                               msSince(start));
+        if (blocks.format != BLOCK_NONE) {
+            capture->blocks[imageIdx] = std::move(blocks);
+        }
+        return true;
+    }
+
+    if (!capture->defer) {
+        // keep the channels stored in the file instead of expanding everything to RGBA
+        tinygltf::LoadImageDataOption option;
+        option.preserve_channels = true;
+        return tinygltf::LoadImageData(image, imageIdx, err, warn, reqWidth, reqHeight, bytes, size, &option);
+    }
+
+    PendingImage p;
+    p.index = imageIdx;
+    p.reqWidth = reqWidth;
+    p.reqHeight = reqHeight;
+    p.bytes.assign(bytes, bytes + size);
+    capture->pending.push_back(std::move(p));
+    return true;
+}
+
+// KHR_texture_basisu is not supported: its KTX2 images carry Basis Universal
+// payloads and there is no transcoder. Only a KTX2 image that loadKtx2 could
+// read (BC or uncompressed data) replaces the texture's source, the others keep
+// their fallback source and are counted in `warn`
+void resolveBasisuTextures(tinygltf::Model &model, const ImageCapture &capture, std::string &warn) {
+    int fallbacks = 0;
+    for (tinygltf::Texture &texture : model.textures) {
+        auto ext = texture.extensions.find("KHR_texture_basisu");
+        if (ext == texture.extensions.end() || !ext->second.Has("source")) continue;
+        int source = ext->second.Get("source").GetNumberAsInt();
+        if (source >= 0 && source < (int) model.images.size() &&
+            (!model.images[source].image.empty() || capture.blocks.count(source))) {
+            texture.source = source;
+        } else {
+            fallbacks++;
+        }
+    }
+    if (fallbacks > 0) {
+        warn += "KHR_texture_basisu is not supported, " + std::to_string(fallbacks) +
+                " textures use their fallback source or none\n";
+    }
+}
+
+}
+
+
+std::string assetName(const tinygltf::Image &image, int index) {
+    // names are not unique, the index is
+    std::string name = std::to_string(index);
+    if (!image.name.empty()) return name + " " + image.name;
+    if (!image.uri.empty() && !tinygltf::IsDataURI(image.uri)) return name + " " + image.uri;
+    return name;
+}
+
+bool decodeImage(tinygltf::Model &model, PendingImage &image, std::string &err, std::string &warn) {
+    auto start = std::chrono::steady_clock::now();
+    tinygltf::Image &decoded = model.images[image.index];
+    tinygltf::LoadImageDataOption option;
+    option.preserve_channels = true;
+    bool ok = tinygltf::LoadImageData(&decoded, image.index, &err, &warn,
+                                      image.reqWidth, image.reqHeight, image.bytes.data(),
+                                      static_cast<int>(image.bytes.size()), &option);
+    loadreport::addDecoded(assetName(decoded, image.index), image.bytes.size(), decoded.image.size(),
+                           msSince(start));
+    std::vector<unsigned char>().swap(image.bytes);
+    return ok;
+}
+
+bool prepareImage(LoadedModel &loaded, PendingImage &image, std::string &err, std::string &warn) {
+    if (!loaded.compressTextures) return decodeImage(loaded.model, image, err, warn);
+
+    CompressedImage &compressed = loaded.compressedImages[image.index];
+    std::string path;
+    if (!loaded.textureCacheDir.empty()) {
+        path = compressedImagePath(loaded.textureCacheDir, image.bytes.data(), image.bytes.size(), loaded.compressBc7);
+        if (readCompressedImage(path, compressed)) {
+            std::vector<unsigned char>().swap(image.bytes);
+            return true;
+        }
+    }
+
+    if (!decodeImage(loaded.model, image, err, warn)) return false;
+    tinygltf::Image &decoded = loaded.model.images[image.index];
+    if (compressImage(decoded, compressed, loaded.compressBc7)) {
+        std::vector<unsigned char>().swap(decoded.image);
+        if (!path.empty() && !writeCompressedImage(path, compressed)) {
+            warn += "Cannot write compressed texture: " + path + "\n";
+        }
+    }
+    return true;
+}
+
+bool loadModel(LoadedModel &loaded, const std::string &filename, const LoadOptions &options) {
+    loadreport::Stage stage("load model");
+    tinygltf::Model &model = loaded.model;
+    tinygltf::TinyGLTF loader;
+    std::string err;
+    std::string warn;
+
+    MappedFile file;
+    if (!file.open(filename, &err)) {
+        std::cout << "ERR: " << err << std::endl;
+        std::cout << "Failed to load glTF: " << filename << std::endl;
+        return false;
+    }
+    file.adviseSequential();
+    loadreport::addRead(filename, file.size());
+
+    // once per process, thread safe as a static initialisation
+    static const bool base64Installed = (installBase64Decoder(), true);
+    (void) base64Installed;
+
+    ImageCapture capture;
+    capture.defer = options.threads != 1 || !options.decodeImages || options.progressive || options.compressTextures;
+    loader.SetImageLoader(captureImageData, &capture);
+    std::vector<PendingImage> &pending = capture.pending;
+
+    MappedFs mappedFs;
+    tinygltf::FsCallbacks callbacks = {
+        &tinygltf::FileExists, &tinygltf::ExpandFilePath,
+        options.mappedIo ? &readMappedFile : &readCountedFile, &tinygltf::WriteWholeFile, nullptr
+    };
+    loader.SetFsCallbacks(callbacks);
+    if (options.mappedIo) {
+        // buffers are never copied out of the .glb or their external file
+        loader.SetBufferMapper(mapBufferData, &mappedFs);
+    }
+
+    // .glb is detected by its magic rather than the extension
+    bool binary = isBinaryGltf(file);
+    bool res = parse(loader, model, file, binary, baseDirectory(filename), err, warn);
+    if (res) {
+        resolveBasisuTextures(model, capture, warn);
+    }
+    loaded.compressTextures = options.compressTextures && options.decodeImages;
+    loaded.compressBc7 = options.compressBc7;
+    loaded.textureCacheDir = options.textureCacheDir;
+    loaded.threads = options.threads;
+    if (res && (loaded.compressTextures || !capture.blocks.empty())) {
+        loaded.compressedImages.resize(model.images.size());
+        for (auto &blocks : capture.blocks) {
+            loaded.compressedImages[blocks.first] = std::move(blocks.second);
+        }
+    }
+    if (res && options.progressive) {
+        loaded.pendingImages = std::move(pending);
+    } else if (res && !pending.empty() && options.decodeImages) {
+        res = decodeImages(loaded, pending, options.threads, err, warn);
+    } else if (res && options.decodeImages) {
+        // the serial decoder ran inside the parse, only the decoded sizes are known
+        for (size_t i = 0; i < model.images.size(); ++i) {
+            loadreport::addDecoded(assetName(model.images[i], i), 0, model.images[i].image.size(), 0.0);
+        }
+    }
+    if (res) {
+        // only a .glb is still referenced after parsing
+        if (!binary) {
+            file.close();
+        }
+        resolveBuffers(loaded, file, mappedFs);
+        res = checkDraco(model, err, warn) && decodeMeshopt(loaded, options.threads, err);
+    }
+
+    if (!warn.empty() && options.verbose) {
+        std::cout << "WARN: " << warn << std::endl;
+    }
+
+    if (!err.empty()) {
+        std::cout << "ERR: " << err << std::endl;
+    }
+
+    if (!res) {
+        std::cout << "Failed to load glTF: " << filename << std::endl;
+        return false;
+    }
+
+    if (model.scenes.empty()) {
+        std::cout << "No scene in glTF: " << filename << std::endl;
+        return false;
+    }
+    // defaultScene is optional, fall back to the first scene
+    if (model.defaultScene < 0 || model.defaultScene >= (int) model.scenes.size()) {
+        model.defaultScene = 0;
+    }
+
+    if (options.verbose) {
+        std::cout << "Loaded glTF: " << filename << std::endl;
+    }
+    return true;
+}
+
+void releasePayloads(LoadedModel &loaded) {
+    // swap with empty vectors, clear() keeps the capacity
+    for (tinygltf::Image &image : loaded.model.images) {
+        std::vector<unsigned char>().swap(image.image);
+    }
+    for (tinygltf::Buffer &buffer : loaded.model.buffers) {
+        std::vector<unsigned char>().swap(buffer.data);
+        // the mappings go with `files` below
+        buffer.mapped_data = nullptr;
+        buffer.mapped_size = 0;
+    }
+    std::vector<CompressedImage>().swap(loaded.compressedImages);
+    loaded.bufferData.clear();
+    loaded.bufferSizes.clear();
+    loaded.files.clear();
+}
+
+size_t residentBytes() {
+#if defined(__APPLE__)
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+#elif defined(__linux__)
+    // second field of statm is the resident page count
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident)) return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+void benchmarkLoad(const std::string &filename, const LoadOptions &options, int runs) {
+    LoadOptions serial = options;
+    serial.threads = 1;
+    serial.verbose = false;
+    LoadOptions parallel = options;
+    parallel.verbose = false;
+    if (parallel.threads == 1) {
+        parallel.threads = 0;
+    }
+
+    auto measure = [&](const char *name, const LoadOptions &opts) {
+        double best = 0.0, total = 0.0;
+        for (int i = 0; i < runs; ++i) {
+            LoadedModel loaded;
+            auto start = std::chrono::steady_clock::now();
+            if (!loadModel(loaded, filename, opts)) return 0.0;
+            double ms = msSince(start);
+            best = i == 0 ? ms : std::min(best, ms);
+            total += ms;
+        }
+        std::cout << name << ": best " << best << " ms, mean " << total / runs << " ms over "
+                  << runs << " runs" << std::endl;
+        return best;
+    };
+
+    double serialMs = measure("serial decode", serial);
+    unsigned int threads = parallel.threads ? parallel.threads : ThreadPool::defaultThreadCount();
+    std::string name = "thread pool (" + std::to_string(threads) + " threads)";
+    double parallelMs = measure(name.c_str(), parallel);
+    if (serialMs > 0.0 && parallelMs > 0.0) {
+        std::cout << "speedup: " << serialMs / parallelMs << "x" << std::endl;
+    }
+}
+
+void benchmarkIo(const std::string &filename, const LoadOptions &options, int runs) {
+    LoadOptions base = options;
+    base.verbose = false;
+    base.decodeImages = false;
+    if (base.threads == 1) {
+        base.threads = 0;
+    }
+
+    auto measure = [&](const char *name, bool mappedIo) {
+        LoadOptions opts = base;
+        opts.mappedIo = mappedIo;
+        double best = 0.0, total = 0.0;
+        long minorBefore, majorBefore, minorAfter, majorAfter;
+        pageFaults(minorBefore, majorBefore);
+        for (int i = 0; i < runs; ++i) {
+            LoadedModel loaded;
+            auto start = std::chrono::steady_clock::now();
+            if (!loadModel(loaded, filename, opts)) return;
+            double ms = msSince(start);
+            best = i == 0 ? ms : std::min(best, ms);
+            total += ms;
+        }
+        pageFaults(minorAfter, majorAfter);
+        std::cout << name << ": best " << best << " ms, mean " << total / runs << " ms, page faults per load "
+                  << (minorAfter - minorBefore) / runs << " minor / " << (majorAfter - majorBefore) / runs
+                  << " major over " << runs << " runs" << std::endl;
+    };
+
+    measure("ifstream", false);
+    measure("mmap", true);
+}
@@ -4,9 +4,23 @@
 #include "shaders.h"
 #include "window.h"
 #include "camera.h"
+#include "async_loader.h"
+#include "base64.h"
+#include "load_report.h"
+#include "loader.h"
+#include "meshopt_decode.h"
+#include "scene.h"
+#include "scene_cache.h"
+#include "scene_graph.h"
+#include "texture.h"
+#include "texture_streamer.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
+#include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 // settings
@@ -22,28 +36,46 @@ const glm::vec3 LOOK_AT = glm::vec3(0, 0, 0);
 const glm::vec3 UP = glm::vec3(0, 1, 0);
 
 
-struct MaterialTex {
-    // texture ids
-    GLuint emissiveId;
-    GLuint normalId;
-    GLuint occlusionId;
-    GLuint baseColorId;
-    GLuint metallicRoughnessId;
-
-    // constant colors
-    glm::vec3 basecolor;
-
-    MaterialTex() : emissiveId(0), normalId(0), occlusionId(0), baseColorId(0), metallicRoughnessId(0) {}
-};
-
 struct TransformationMat {
-    glm::mat4 model;
     glm::mat4 view;
     glm::mat4 proj;
 };
 
 Camera camera;
 
+// set by the key callback, handled once per frame
+bool nextModelRequested = false;
+bool reloadRequested = false;
+
+// reports the time spent in each startup stage until the first frame is on screen
+struct StartupTimer {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start, last;
+
+    StartupTimer() : start(Clock::now()), last(start) {}
+
+    void report(const char *stage) {
+        Clock::time_point now = Clock::now();
+        std::cout << "startup: " << stage << " " << msBetween(last, now) << " ms (total "
+                  << msBetween(start, now) << " ms)" << std::endl;
+        last = now;
+    }
+
+    static double msBetween(Clock::time_point from, Clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+};
+
+// frees the CPU copies of everything that has been uploaded and prints what that saved
+void releaseModel(LoadedModel &loaded) {
+    const double MB = 1024.0 * 1024.0;
+    size_t before = residentBytes();
+    releasePayloads(loaded);
+    size_t after = residentBytes();
+    std::cout << "memory: resident " << before / MB << " MB before releasing the model, "
+              << after / MB << " MB after" << std::endl;
+}
+
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
@@ -70,318 +102,85 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
     camera.processCursorPos(xpos, ypos);
 }
 
-
-bool loadModel(tinygltf::Model &model, const char *filename) {
-    tinygltf::TinyGLTF loader;
-    std::string err;
-    std::string warn;
-
-    bool res = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-    if (!warn.empty()) {
-        std::cout << "WARN: " << warn << std::endl;
-    }
-
-    if (!err.empty()) {
-        std::cout << "ERR: " << err << std::endl;
-    }
-
-    if (!res)
-        std::cout << "Failed to load glTF: " << filename << std::endl;
-    else
-        std::cout << "Loaded glTF: " << filename << std::endl;
-
-    return res;
-}
-
-int createTexture(tinygltf::Model &model, int texIndex) {
-
-    tinygltf::Texture &tex = model.textures[texIndex];
-
-    GLuint texid;
-    glGenTextures(1, &texid);
-
-    tinygltf::Image &image = model.images[tex.source];
-    tinygltf::Sampler sampler = model.samplers[tex.sampler];
-
-    glBindTexture(GL_TEXTURE_2D, texid);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    if (sampler.minFilter != -1)
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampler.minFilter);
-    if (sampler.magFilter != -1)
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.magFilter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sampler.wrapS);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, sampler.wrapT);
-
-    GLenum format = GL_RGBA;
-
-    if (image.component == 1) {
-        format = GL_RED;
-    } else if (image.component == 2) {
-        format = GL_RG;
-    } else if (image.component == 3) {
-        format = GL_RGB;
-    } else {
-        // ???
-    }
-
-    GLenum type = GL_UNSIGNED_BYTE;
-    if (image.bits == 8) {
-        // ok
-    } else if (image.bits == 16) {
-        type = GL_UNSIGNED_SHORT;
-    } else {
-        // ???
+// N switches to the next model given on the command line, R reloads the current one
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS) return;
+    if (key == GLFW_KEY_N) {
+        nextModelRequested = true;
+    } else if (key == GLFW_KEY_R) {
+        reloadRequested = true;
     }
-
-    glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0,
-                 format, type, &image.image.at(0));
-    glGenerateMipmap(GL_TEXTURE_2D);
-    return texid;
 }
 
 
-
-void bindMesh(std::vector<MaterialTex> &matTexs, std::vector<GLuint> &vaos, tinygltf::Model &model,
-              tinygltf::Mesh &mesh) {
-
-    for (size_t i = 0; i < mesh.primitives.size(); ++i) {
-        tinygltf::Primitive primitive = mesh.primitives[i];
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-        tinygltf::BufferView &indexBufferView = model.bufferViews[indexAccessor.bufferView];
-        tinygltf::Buffer &indexBuffer = model.buffers[indexBufferView.buffer];
-
-        GLuint vao;
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-        vaos.push_back(vao);
-
-        unsigned int ebo;
-        glGenBuffers(1, &ebo);
-
-        glBindBuffer(indexBufferView.target, ebo);
-        glBufferData(indexBufferView.target, indexBufferView.byteLength,
-                     &indexBuffer.data.at(0) + indexBufferView.byteOffset, GL_STATIC_DRAW);
-
-
-        for (auto &attrib : primitive.attributes) {
-            const tinygltf::Accessor accessor = model.accessors[attrib.second];
-            const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-            const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-            GLuint vbo;
-            glGenBuffers(1, &vbo);
-            glBindBuffer(bufferView.target, vbo);
-
-
-            glBufferData(bufferView.target, bufferView.byteLength,
-                         &buffer.data.at(0) + bufferView.byteOffset, GL_STATIC_DRAW);
-
-            int byteStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
-            int size = 1;
-            if (accessor.type != TINYGLTF_TYPE_SCALAR) {
-                size = accessor.type;
-            }
-
-            int vaa = -1;
-            if (attrib.first.compare("POSITION") == 0) vaa = 0;
-            if (attrib.first.compare("NORMAL") == 0) vaa = 1;
-            if (attrib.first.compare("TEXCOORD_0") == 0) vaa = 2;
-            if (vaa > -1) {
-                glVertexAttribPointer(vaa, size, accessor.componentType,
-                                      accessor.normalized ? GL_TRUE : GL_FALSE,
-                                      byteStride, BUFFER_OFFSET(accessor.byteOffset));
-                glEnableVertexAttribArray(vaa);
-            } else
-                std::cout << "vaa missing: " << attrib.first << std::endl;
-        }
-
-        MaterialTex matTex;
-        matTex.baseColorId = 0;
-        matTexs.push_back(matTex);
-
-        tinygltf::Material material = model.materials[primitive.material];
-
-        if (material.pbrMetallicRoughness.baseColorTexture.index != -1) {
-            matTexs.back().baseColorId = createTexture(
-                model, material.pbrMetallicRoughness.baseColorTexture.index);
-        } else {
-            std::vector<double> basecolorFactor = material.pbrMetallicRoughness.baseColorFactor;
-            matTexs.back().basecolor = glm::vec3(basecolorFactor[0], basecolorFactor[1], basecolorFactor[2]);
+void drawModel(const Shaders &shader, const RenderScene &scene, const TransformationMat &transMat) {
+    // matrices come precomputed with the draw list and uniform locations with the shader,
+    // so nothing here allocates or looks anything up by name
+    const DrawUniforms &uniforms = shader.uniforms;
+    const bool lit = shader.type == ShaderType::SCENE;
+    const glm::mat4 viewProj = transMat.proj * transMat.view;
+
+    // draws of the same layout and arena buffers share a VAO, draws of a material its texture
+    GLuint boundVao = 0;
+    GLuint boundTexture = 0;
+    GLuint boundSampler = 0;
+    int textured = -1;
+    for (const DrawItem &item : scene.draws) {
+        if (item.vao != boundVao) {
+            glBindVertexArray(item.vao);
+            boundVao = item.vao;
         }
 
-    }
-}
-
-// bind models
-void bindModelNodes(std::vector<MaterialTex> &matTexs, std::vector<GLuint> &vaos, tinygltf::Model &model,
-                    tinygltf::Node &node) {
-    if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
-        bindMesh(matTexs, vaos, model, model.meshes[node.mesh]);
-    }
-}
-
-std::pair<std::vector<GLuint>, std::vector<MaterialTex>> bindModel(tinygltf::Model &model) {
-    std::vector<GLuint> vaos;
-    std::vector<MaterialTex> matTexs;
-    const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-    for (size_t i = 0; i < scene.nodes.size(); ++i) {
-
-        // skip light nodes
-        if (!model.nodes[i].extensions.empty()) continue;
-
-        assert((scene.nodes[i] >= 0) && (scene.nodes[i] < model.nodes.size()));
-        bindModelNodes(matTexs, vaos, model, model.nodes[scene.nodes[i]]);
-    }
-
-
-    return {vaos, matTexs};
-}
-
-glm::mat4 createTranslationMatrix(std::vector<double> trans) {
-    glm::mat4 transMat;
-    if (trans.size() > 0) {
-        transMat =  glm::translate(glm::mat4(1.0f),  glm::vec3(trans[0], trans[1], trans[2]));
-    } else {
-        transMat =  glm::mat4(1.0f);
-    }
-    return transMat;
-
-}
-
-glm::mat4 createRotationMatrix(std::vector<double> rot) {
-    glm::mat4 rotMat;
-    if (rot.size() > 0) {
-        glm::quat quat = glm::quat(rot[3], rot[0], rot[1], rot[2]);
-        rotMat =  glm::mat4_cast(quat);
-    } else {
-        glm::quat quat = glm::quat(1, 0, 0, 0);
-        rotMat =  glm::mat4_cast(quat);
-//        rotMat = glm::mat4(1.0f);
-    }
-    return rotMat;
-
-}
-
-glm::mat4 createScaleMatrix(std::vector<double> scale) {
-    glm::mat4 scaleMat;
-    if (scale.size() > 0) {
-        scaleMat = glm::scale(glm::mat4(1.0f),  glm::vec3(scale[0], scale[1], scale[2]));
-    } else {
-        scaleMat = glm::mat4(1.0f);
-    }
-    return scaleMat;
-}
-
-glm::mat4 createModelMatrix(tinygltf::Node node) {
-    glm::mat4 translationMatrix = createTranslationMatrix(node.translation);
-    glm::mat4  rotationMatrix = createRotationMatrix(node.rotation);
-    glm::mat4 scaleMatrix = createScaleMatrix(node.scale);
-    glm::mat4 model = translationMatrix * rotationMatrix * scaleMatrix;
-    return model;
-}
-
-
-void drawMesh(Shaders &shader,
-              int &vaoId,
-              const std::vector<GLuint>& vaos,
-              const std::vector<MaterialTex>& matTexs,
-              TransformationMat& transMat,
-              tinygltf::Model &model,
-              tinygltf::Mesh &mesh) {
-    glm::mat4 mvp = transMat.proj * transMat.view * transMat.model;
-    glm::mat4 normalMatrix = glm::transpose(glm::inverse(transMat.model));
-
-    for (size_t i = 0; i < mesh.primitives.size(); ++i) {
-        glBindVertexArray(vaos[vaoId]);
-
-        if (shader.type == ShaderType::SCENE) {
-            // to regular shader
-            // ---------------------------------------------------------------
-            shader.setMat4("mvp", mvp);
-            shader.setMat4("normal_matrix", normalMatrix);
-
-            int textured;
-            if (matTexs[vaoId].baseColorId > 0) {
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, matTexs[vaoId].baseColorId);
-                textured = 1;
+        if (lit) {
+            glm::mat4 mvp = viewProj * item.model;
+            glUniformMatrix4fv(uniforms.mvp, 1, GL_FALSE, &mvp[0][0]);
+            glUniformMatrix4fv(uniforms.normalMatrix, 1, GL_FALSE, &item.normal[0][0]);
+
+            const MaterialTex &material = item.material;
+            int itemTextured = material.baseColorId > 0 ? 1 : 0;
+            if (itemTextured) {
+                if (material.baseColorId != boundTexture) {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, material.baseColorId);
+                    boundTexture = material.baseColorId;
+                }
+                if (material.baseColorSampler != boundSampler) {
+                    glBindSampler(0, material.baseColorSampler);
+                    boundSampler = material.baseColorSampler;
+                }
+                glUniformMatrix3fv(uniforms.uvTransform, 1, GL_FALSE, &material.uvTransform[0][0]);
             } else {
-                glm::vec3 basecolor = matTexs[vaoId].basecolor;
-                shader.setVec3("basecolor", basecolor);
-                textured = 0;
+                glUniform3fv(uniforms.basecolor, 1, &material.basecolor[0]);
+            }
+            if (itemTextured != textured) {
+                glUniform1i(uniforms.textured, itemTextured);
+                textured = itemTextured;
             }
-            shader.setInt("textured", textured);
-            // ---------------------------------------------------------------
         }
-        shader.setMat4("model", transMat.model);
-
-        vaoId++;
-
-        tinygltf::Primitive primitive = mesh.primitives[i];
-        tinygltf::Accessor indexAccessor = model.accessors[primitive.indices];
-
-        glDrawElements(primitive.mode, indexAccessor.count,
-                       indexAccessor.componentType,
-                       BUFFER_OFFSET(indexAccessor.byteOffset));
-    }
-}
-
-void drawModelNodes(Shaders &shader, int &vaoId,
-                    const std::vector<GLuint>& vaos, const std::vector<MaterialTex>& matTexs,
-                    TransformationMat& transMat,
-                    tinygltf::Model &model,
-                    tinygltf::Node &node) {
-    if ((node.mesh >= 0) && (node.mesh < model.meshes.size())) {
+        glUniformMatrix4fv(uniforms.model, 1, GL_FALSE, &item.model[0][0]);
 
-        glm::mat4 modelMatrix = createModelMatrix(node);
-        transMat.model = modelMatrix;
-        drawMesh(shader, vaoId, vaos, matTexs, transMat, model, model.meshes[node.mesh]);
+        glDrawElementsBaseVertex(item.mode, item.count, item.indexType, BUFFER_OFFSET(item.indexOffset),
+                                 item.baseVertex);
     }
 }
-void drawModel(Shaders &shader,
-               const std::vector<GLuint>& vaos,
-               const std::vector<MaterialTex>& matTexs,
-               TransformationMat& transMat,
-               tinygltf::Model &model) {
-    const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-    int vaoId = 0;
-    for (size_t i = 0; i < scene.nodes.size(); ++i) {
-        drawModelNodes(shader, vaoId, vaos, matTexs, transMat, model, model.nodes[scene.nodes[i]]);
-    }
-}
-
-
-
-glm::vec3 setUpLighting(TransformationMat &transMat, tinygltf::Model &model, Shaders &shader) {
-    glm::vec3 lightWorldPos;
-    for(auto node : model.nodes) {
-        // skip non-light nodes
-        if (node.extensions.empty()) continue;
-
-        int lightId = node.extensions["KHR_lights_punctual"].Get("light").GetNumberAsInt();
-        tinygltf::Light light = model.lights[lightId];
-
-        // skip directional light
-        if (light.type != "point") continue;
-
-        glm::mat4 modelMatrix = createModelMatrix(node);
-        // TODO @mswamy check: do we need perspective divide here?
-        lightWorldPos = modelMatrix * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 
-//        std::cout << glm::to_string(lightWorldPos) << std::endl;
-//        std::cout << glm::to_string(modelMatrix * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)) << std::endl;
 
-        glm::vec3 color = glm::vec3(light.color[0], light.color[1], light.color[2]);
 
-        shader.setVec3("light_position", lightWorldPos);
-        shader.setVec3("light_color", color);
+glm::vec3 setUpLighting(const RenderScene &scene, Shaders &shader) {
+    glm::vec3 lightWorldPos(0.0f);
+    for (const PointLight &light : scene.lights) {
+        lightWorldPos = light.position;
+        shader.setVec3("light_position", light.position);
+        shader.setVec3("light_color", light.color);
     }
     return lightWorldPos;
 
 }
 
-void displayLoop(Window &window, const std::string &filename) {
+void displayLoop(Window &window, RenderScene &scene, StartupTimer &startup,
+                 std::unique_ptr<TextureStreamer> &streamer, const std::function<void(bool)> &onLoaded,
+                 AsyncSceneLoader &loader, const std::vector<std::string> &filenames, ThreadPool *transformPool) {
     Shaders shader = Shaders(
         ShaderType::SCENE,
         "../shaders/scene.vert",
@@ -393,6 +192,8 @@ void displayLoop(Window &window, const std::string &filename) {
         "../shaders/point_shadows_depth.frag",
         "../shaders/point_shadows_depth.geom"
         );
+    // all six matrices are set through the location of the first
+    GLint shadowMatricesLoc = glGetUniformLocation(depthShader.pid, "shadowMatrices");
 
     // configure depth map FBO
     // -----------------------
@@ -415,20 +216,44 @@ void displayLoop(Window &window, const std::string &filename) {
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    startup.report("shaders");
 
     camera = Camera(EYE, LOOK_AT, UP, SCR_WIDTH, SCR_HEIGHT);
 
-    tinygltf::Model model;
-    if (!loadModel(model, filename.c_str())) return;
-
-    auto bindingData = bindModel(model);
-    std::vector<GLuint> vaos = bindingData.first;
-    std::vector<MaterialTex> matTexs = bindingData.second;
-
+    bool firstFrame = true;
+    size_t current = 0;
     while (!window.Close()) {
         window.Resize();
         processInput(window.window);
 
+        // models are loaded and uploaded in the background, the old one stays on screen meanwhile
+        if (nextModelRequested || reloadRequested) {
+            if (nextModelRequested) current = (current + 1) % filenames.size();
+            loader.request(filenames[current]);
+            nextModelRequested = reloadRequested = false;
+        }
+        std::string switched;
+        if (loader.poll(scene, switched)) {
+            std::cout << "switched to " << switched << std::endl;
+            // the streamer belongs to the first model, its pending decodes are dropped and the model is released
+            if (streamer) {
+                bool finished = streamer->finished();
+                streamer.reset();
+                if (!finished) onLoaded(false);
+            }
+        }
+
+        // only subtrees whose nodes moved since the last frame are recomputed
+        updateTransforms(scene, transformPool);
+
+        if (streamer && !streamer->finished()) {
+            streamer->upload(scene, camera.position);
+            if (streamer->finished()) {
+                startup.report("textures streamed");
+                onLoaded(true);
+            }
+        }
+
         glClearColor(0.2, 0.2, 0.2, 1.0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -441,20 +266,21 @@ void displayLoop(Window &window, const std::string &filename) {
         transMat.view = camera.view;
 
         shader.use();
-        glm::vec3 lightWorldPos = setUpLighting(transMat, model, shader);
+        glm::vec3 lightWorldPos = setUpLighting(scene, shader);
 
         // 0. create depth cubemap transformation matrices
         // -----------------------------------------------
         float near_plane = 1.0f;
         float far_plane  = 25.0f;
         glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT, near_plane, far_plane);
-        std::vector<glm::mat4> shadowTransforms;
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
-        shadowTransforms.push_back(shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f)));
+        glm::mat4 shadowTransforms[6] = {
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f, -1.0f,  0.0f), glm::vec3(0.0f,  0.0f, -1.0f)),
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+            shadowProj * glm::lookAt(lightWorldPos, lightWorldPos + glm::vec3( 0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        };
 
         // 1. render scene to depth cubemap
         // --------------------------------
@@ -462,11 +288,10 @@ void displayLoop(Window &window, const std::string &filename) {
         glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
         glClear(GL_DEPTH_BUFFER_BIT);
         depthShader.use();
-        for (unsigned int i = 0; i < 6; ++i)
-            depthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
+        glUniformMatrix4fv(shadowMatricesLoc, 6, GL_FALSE, &shadowTransforms[0][0][0]);
         depthShader.setFloat("far_plane", far_plane);
         depthShader.setVec3("lightPos", lightWorldPos);
-        drawModel(depthShader, vaos, matTexs, transMat, model);
+        drawModel(depthShader, scene, transMat);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         // 2. render scene as normal
@@ -481,28 +306,98 @@ void displayLoop(Window &window, const std::string &filename) {
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
 
-        drawModel(shader, vaos, matTexs, transMat, model);
+        drawModel(shader, scene, transMat);
         glfwSwapBuffers(window.window);
         glfwPollEvents();
-    }
 
-    for (int i = 0; i < vaos.size(); ++i) {
-        glDeleteVertexArrays(1, &vaos[i]);
+        if (firstFrame) {
+            startup.report("first frame");
+            firstFrame = false;
+            // a progressive load is complete once streaming is done
+            if (!streamer) onLoaded(true);
+        }
     }
+
+    scene.release();
 }
 
 
 
 int main(int argc, char **argv)
 {
-    std::string filename = "../scene/separate/assets.gltf";
+    StartupTimer startup;
+    std::vector<std::string> filenames;
+    LoadOptions loadOptions;
+    bool benchLoad = false;
+    bool benchIo = false;
+    bool benchMeshopt = false;
+    bool benchCompress = false;
+    size_t benchBase64MB = 0;
+    size_t benchTransformNodes = 0;
+    bool useCache = true;
+    std::string cacheDir = "scene_cache";
+    double uploadBudgetMs = 4.0;
+    bool loadReport = false;
+    std::string loadReportJson;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            loadOptions.threads = std::stoi(argv[++i]);
+        } else if (arg == "--bench-load") {
+            benchLoad = true;
+        } else if (arg == "--bench-io") {
+            benchIo = true;
+        } else if (arg == "--bench-meshopt") {
+            benchMeshopt = true;
+        } else if (arg == "--bench-compress") {
+            benchCompress = true;
+        } else if (arg == "--bench-base64" && i + 1 < argc) {
+            benchBase64MB = std::stoul(argv[++i]);
+        } else if (arg == "--bench-transforms" && i + 1 < argc) {
+            benchTransformNodes = std::stoul(argv[++i]);
+        } else if (arg == "--no-mmap") {
+            loadOptions.mappedIo = false;
+        } else if (arg == "--progressive") {
+            loadOptions.progressive = true;
+        } else if (arg == "--upload-budget" && i + 1 < argc) {
+            uploadBudgetMs = std::stod(argv[++i]);
+        } else if (arg == "--no-cache") {
+            useCache = false;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (arg == "--compress-textures") {
+            loadOptions.compressTextures = true;
+        } else if (arg == "--load-report") {
+            loadReport = true;
+        } else if (arg == "--load-report-json" && i + 1 < argc) {
+            loadReportJson = argv[++i];
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+    if (filenames.empty()) {
+        filenames.push_back("../scene/separate/assets.gltf");
+    }
+    const std::string &filename = filenames[0];
 
-    if (argc > 1) {
-        filename = argv[1];
+    if (useCache) {
+        loadOptions.textureCacheDir = cacheDir;
     }
 
-    tinygltf::Model model;
-    if (!loadModel(model, filename.c_str())) return -1;
+    if (benchBase64MB > 0 || benchTransformNodes > 0) {
+        if (benchBase64MB > 0) benchmarkBase64(benchBase64MB, 5);
+        if (benchTransformNodes > 0) benchmarkTransforms(benchTransformNodes, 5);
+        return 0;
+    }
+    if (benchLoad || benchIo || benchMeshopt || benchCompress) {
+        loadOptions.progressive = false;
+        if (benchLoad) benchmarkLoad(filename, loadOptions, 5);
+        if (benchIo) benchmarkIo(filename, loadOptions, 5);
+        if (benchMeshopt) benchmarkMeshopt(filename, loadOptions, 5);
+        if (benchCompress) benchmarkCompress(filename, 3);
+        return 0;
+    }
 
     // glfw: initialize and configure
     // ------------------------------
@@ -520,6 +415,7 @@ int main(int argc, char **argv)
     glfwMakeContextCurrent(window.window);
     glfwSetFramebufferSizeCallback(window.window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window.window, cursor_position_callback); // doing nothing for now
+    glfwSetKeyCallback(window.window, key_callback);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -531,14 +427,85 @@ int main(int argc, char **argv)
 
     std::cout << glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION)
               << std::endl;
+    // BC1 and BC3 only sample with S3TC, so the context is asked before anything is compressed or cached
+    if (loadOptions.compressTextures && !textureCompressionSupported()) {
+        std::cout << "WARN: no EXT_texture_compression_s3tc, textures stay uncompressed" << std::endl;
+        loadOptions.compressTextures = false;
+    }
+    loadOptions.compressBc7 = loadOptions.compressTextures && bptcSupported();
 
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glEnable(GL_BLEND);
+    startup.report("window and context");
+
+    // a valid scene cache replaces parsing and decoding altogether
+    SceneCache cache(cacheDir, filename, loadOptions);
+    bool cached = useCache && cache.open();
+    if (cached) {
+        startup.report("open scene cache");
+    }
 
-    displayLoop(window, filename);
+    // only the draw list outlives binding, the model's payloads are released after upload
+    LoadedModel loaded;
+    if (!cached) {
+        if (!loadModel(loaded, filename, loadOptions)) return -1;
+        startup.report("load model");
+    }
+
+    RenderScene scene;
+    // splits large levels of the node hierarchy when many nodes move in one frame, --threads 1 keeps it on this thread
+    std::unique_ptr<ThreadPool> transformPool;
+    if (loadOptions.threads != 1) transformPool.reset(new ThreadPool(loadOptions.threads));
+    std::unique_ptr<TextureStreamer> streamer;
+    if (cached && cache.upload(scene)) {
+        createVertexArrays(scene);
+        startup.report("upload scene cache");
+    } else {
+        if (cached && !loadModel(loaded, filename, loadOptions)) return -1;
+        scene = bindModel(loaded);
+        createVertexArrays(scene);
+        startup.report("bind model");
+        // decoding starts after binding, which reads the images it writes
+        if (!loaded.pendingImages.empty()) {
+            streamer.reset(new TextureStreamer(loaded, scene, loadOptions.threads, uploadBudgetMs));
+        }
+        // a progressive load is cached once every texture has arrived
+        if (useCache && !streamer && cache.write(scene, loaded)) {
+            startup.report("write scene cache");
+        }
+        // a streaming load still decodes into the model, it is released once streaming is done
+        if (!streamer) {
+            releaseModel(loaded);
+        }
+    }
+
+    // runs once for the first model: when it is on screen, when streaming finished, or with
+    // `complete` false when another model replaced it before all of its textures arrived
+    bool streaming = streamer != nullptr;
+    auto onLoaded = [&](bool complete) {
+        if (streaming) {
+            // the scene is only the first model's, and only worth caching, when streaming completed
+            if (complete && useCache && cache.write(scene, loaded)) {
+                startup.report("write scene cache");
+            }
+            releaseModel(loaded);
+        }
+        if (loadReport) {
+            loadreport::print(std::cout);
+        }
+        if (!loadReportJson.empty()) {
+            std::ofstream out(loadReportJson);
+            loadreport::printJson(out);
+        }
+    };
+    // the loader's context and the streamer's PBOs need the window, so they go before glfwTerminate
+    std::unique_ptr<AsyncSceneLoader> loader(new AsyncSceneLoader(window, loadOptions, cacheDir, useCache));
+    displayLoop(window, scene, startup, streamer, onLoaded, *loader, filenames, transformPool.get());
+    loader.reset();
+    streamer.reset();
 
     glfwTerminate();
     return 0;
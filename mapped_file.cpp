@@ -0,0 +1,114 @@
+#include "include/mapped_file.h"
+
+#include <fstream>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        bytes = other.bytes;
+        length = other.length;
+        mapped = other.mapped;
+        copy = std::move(other.copy);
+        if (!mapped && !copy.empty()) {
+            bytes = copy.data();
+        }
+        other.bytes = nullptr;
+        other.length = 0;
+        other.mapped = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string &path, std::string *err)
+{
+    close();
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (err) *err = "cannot open " + path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        if (err) *err = "cannot stat or empty file " + path;
+        return false;
+    }
+
+    void *ptr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        if (err) *err = "cannot mmap " + path;
+        return false;
+    }
+
+    bytes = static_cast<const unsigned char *>(ptr);
+    length = (size_t) st.st_size;
+    mapped = true;
+    return true;
+#else
+    std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    if (!ifs) {
+        if (err) *err = "cannot open " + path;
+        return false;
+    }
+
+    std::ifstream::pos_type fileSize = ifs.tellg();
+    if (fileSize <= 0) {
+        if (err) *err = "empty file " + path;
+        return false;
+    }
+    ifs.seekg(0, std::ios::beg);
+    copy.resize((size_t) fileSize);
+    ifs.read(reinterpret_cast<char *>(copy.data()), fileSize);
+
+    bytes = copy.data();
+    length = copy.size();
+    return true;
+#endif
+}
+
+void MappedFile::adviseSequential() const
+{
+#ifndef _WIN32
+    if (mapped) {
+        madvise(const_cast<unsigned char *>(bytes), length, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<unsigned char *>(bytes), length);
+    }
+#endif
+    std::vector<unsigned char>().swap(copy);
+    bytes = nullptr;
+    length = 0;
+    mapped = false;
+}
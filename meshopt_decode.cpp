@@ -0,0 +1,1107 @@
+#include "include/meshopt_decode.h"
+#include "include/load_report.h"
+#include "include/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MESHOPT_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+const char *EXTENSION = "EXT_meshopt_compression";
+
+// vertex codec: every byte of the stride is coded as its own stream of deltas
+// in groups of 16, blocks of up to 256 vertices fit 8 KB
+const size_t BYTE_GROUP = 16;
+// a group reads at most 8 bytes of packed codes and 16 escaped bytes
+const size_t BYTE_GROUP_DECODE_LIMIT = 24;
+const size_t VERTEX_BLOCK_BYTES = 8192;
+const size_t VERTEX_BLOCK_MAX = 256;
+// the first vertex is stored at the end, padded to at least this size
+const size_t VERTEX_TAIL_MIN = 32;
+
+const unsigned char VERTEX_HEADER = 0xa0;
+// the low nibble of the index headers is the codec version, the extension writes 1
+const unsigned char INDEX_HEADER = 0xe0;
+const unsigned char SEQUENCE_HEADER = 0xd0;
+const int INDEX_VERSION_MAX = 1;
+
+// filter kernels, decodeFilter takes the fastest the CPU runs
+enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_SSE41,
+};
+
+enum MeshoptMode {
+    MODE_ATTRIBUTES,
+    MODE_TRIANGLES,
+    MODE_INDICES,
+};
+
+// one compressed bufferView resolved to its source bytes and its destination
+struct DecodeJob {
+    int view;
+    const unsigned char *src;
+    size_t size;
+    unsigned char *dst;
+    size_t count;
+    size_t stride;
+    MeshoptMode mode;
+    MeshoptFilter filter;
+};
+
+size_t vertexBlockSize(size_t stride) {
+    size_t result = VERTEX_BLOCK_BYTES / stride;
+    // a block fills whole byte groups
+    result &= ~(BYTE_GROUP - 1);
+    return std::min(result, VERTEX_BLOCK_MAX);
+}
+
+unsigned char unzigzag8(unsigned char v) {
+    return (unsigned char) (-(v & 1) ^ (v >> 1));
+}
+
+// 16 codes of BITS bits, most significant first, followed by the bytes of the
+// codes that hold the escape value (all bits set)
+template <int BITS>
+const unsigned char *unpackGroup(const unsigned char *data, unsigned char *out) {
+    const int escape = (1 << BITS) - 1;
+    const unsigned char *extra = data + BYTE_GROUP * BITS / 8;
+    for (size_t i = 0; i < BYTE_GROUP; ++i) {
+        int shift = 8 - BITS - (int) (i * BITS) % 8;
+        int code = (data[i * BITS / 8] >> shift) & escape;
+        out[i] = code == escape ? *extra : (unsigned char) code;
+        extra += code == escape;
+    }
+    return extra;
+}
+
+const unsigned char *decodeBytesGroup(const unsigned char *data, unsigned char *out, int bitslog2) {
+    switch (bitslog2) {
+    case 0:
+        std::memset(out, 0, BYTE_GROUP);
+        return data;
+    case 1:
+        return unpackGroup<2>(data, out);
+    case 2:
+        return unpackGroup<4>(data, out);
+    default:
+        std::memcpy(out, data, BYTE_GROUP);
+        return data + BYTE_GROUP;
+    }
+}
+
+// `size` bytes in groups of 16, two header bits per group select 0, 2, 4 or 8 bits per byte
+const unsigned char *decodeBytes(const unsigned char *data, const unsigned char *end, unsigned char *out, size_t size) {
+    size_t headerSize = (size / BYTE_GROUP + 3) / 4;
+    if ((size_t) (end - data) < headerSize) return nullptr;
+    const unsigned char *header = data;
+    data += headerSize;
+
+    for (size_t i = 0; i < size; i += BYTE_GROUP) {
+        if ((size_t) (end - data) < BYTE_GROUP_DECODE_LIMIT) return nullptr;
+        size_t group = i / BYTE_GROUP;
+        int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        data = decodeBytesGroup(data, out + i, bitslog2);
+    }
+    return data;
+}
+
+const unsigned char *decodeVertexBlock(const unsigned char *data, const unsigned char *end, unsigned char *dst,
+                                       size_t count, size_t stride, unsigned char last[256]) {
+    unsigned char deltas[VERTEX_BLOCK_MAX];
+    size_t alignedCount = (count + BYTE_GROUP - 1) & ~(BYTE_GROUP - 1);
+
+    for (size_t k = 0; k < stride; ++k) {
+        data = decodeBytes(data, end, deltas, alignedCount);
+        if (!data) return nullptr;
+
+        unsigned char p = last[k];
+        unsigned char *out = dst + k;
+        for (size_t i = 0; i < count; ++i, out += stride) {
+            p = (unsigned char) (unzigzag8(deltas[i]) + p);
+            *out = p;
+        }
+    }
+    std::memcpy(last, dst + stride * (count - 1), stride);
+    return data;
+}
+
+void writeIndex(unsigned char *dst, size_t i, size_t stride, uint32_t index) {
+    if (stride == 2) {
+        uint16_t v = (uint16_t) index;
+        std::memcpy(dst + i * 2, &v, 2);
+    } else {
+        std::memcpy(dst + i * 4, &index, 4);
+    }
+}
+
+void writeTriangle(unsigned char *dst, size_t i, size_t stride, uint32_t a, uint32_t b, uint32_t c) {
+    writeIndex(dst, i, stride, a);
+    writeIndex(dst, i + 1, stride, b);
+    writeIndex(dst, i + 2, stride, c);
+}
+
+uint32_t decodeVByte(const unsigned char *&data) {
+    unsigned char lead = *data++;
+    if (lead < 128) return lead;
+
+    // at most 4 more bytes, so malformed data cannot run on
+    uint32_t result = lead & 127;
+    uint32_t shift = 7;
+    for (int i = 0; i < 4; ++i) {
+        unsigned char group = *data++;
+        result |= (uint32_t) (group & 127) << shift;
+        shift += 7;
+        if (group < 128) break;
+    }
+    return result;
+}
+
+// free indices are zigzag deltas to the last free index
+uint32_t decodeIndex(const unsigned char *&data, uint32_t last) {
+    uint32_t v = decodeVByte(data);
+    uint32_t d = (v >> 1) ^ (uint32_t) -(int32_t) (v & 1);
+    return last + d;
+}
+
+void pushVertexFifo(uint32_t fifo[16], uint32_t v, size_t &offset, int cond = 1) {
+    fifo[offset] = v;
+    offset = (offset + cond) & 15;
+}
+
+void pushEdgeFifo(uint32_t fifo[16][2], uint32_t a, uint32_t b, size_t &offset) {
+    fifo[offset][0] = a;
+    fifo[offset][1] = b;
+    offset = (offset + 1) & 15;
+}
+
+// rounds to the nearest integer, halves away from zero
+int roundSigned(float v) {
+    return (int) (v + (v >= 0.f ? 0.5f : -0.5f));
+}
+
+// the loops below are branch free so the compiler can vectorize them
+template <typename T>
+void decodeFilterOct(T *data, size_t count) {
+    const float max = (float) ((1 << (sizeof(T) * 8 - 1)) - 1);
+    for (size_t i = 0; i < count; ++i) {
+        // z is stored as the value of 1.0 at this bit count
+        float x = (float) data[i * 4 + 0];
+        float y = (float) data[i * 4 + 1];
+        float z = (float) data[i * 4 + 2] - std::fabs(x) - std::fabs(y);
+
+        // unfold the lower hemisphere
+        float t = std::min(z, 0.f);
+        x += x >= 0.f ? t : -t;
+        y += y >= 0.f ? t : -t;
+
+        float s = max / std::sqrt(x * x + y * y + z * z);
+        data[i * 4 + 0] = (T) roundSigned(x * s);
+        data[i * 4 + 1] = (T) roundSigned(y * s);
+        data[i * 4 + 2] = (T) roundSigned(z * s);
+    }
+}
+
+void decodeFilterQuat(int16_t *data, size_t count) {
+    const float scale = 1.f / std::sqrt(2.f);
+    for (size_t i = 0; i < count; ++i) {
+        // the fourth component holds the scale in its upper bits and the index of
+        // the dropped component in the lower two
+        int sf = data[i * 4 + 3] | 3;
+        float ss = scale / (float) sf;
+
+        float x = (float) data[i * 4 + 0] * ss;
+        float y = (float) data[i * 4 + 1] * ss;
+        float z = (float) data[i * 4 + 2] * ss;
+        // clamped against rounding below 0
+        float ww = 1.f - x * x - y * y - z * z;
+        float w = std::sqrt(std::max(ww, 0.f));
+
+        int qc = data[i * 4 + 3] & 3;
+        data[i * 4 + ((qc + 1) & 3)] = (int16_t) roundSigned(x * 32767.f);
+        data[i * 4 + ((qc + 2) & 3)] = (int16_t) roundSigned(y * 32767.f);
+        data[i * 4 + ((qc + 3) & 3)] = (int16_t) roundSigned(z * 32767.f);
+        data[i * 4 + ((qc + 0) & 3)] = (int16_t) (w * 32767.f + 0.5f);
+    }
+}
+
+void decodeFilterExp(uint32_t *data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v = data[i];
+        // 24-bit signed mantissa and 8-bit signed exponent
+        int32_t m = (int32_t) (v << 8) >> 8;
+        int32_t e = (int32_t) v >> 24;
+
+        // ldexp(m, e) as a multiplication by the power of two built from its bits
+        uint32_t bits = (uint32_t) (e + 127) << 23;
+        float f;
+        std::memcpy(&f, &bits, 4);
+        f *= (float) m;
+        std::memcpy(&data[i], &f, 4);
+    }
+}
+
+#ifdef MESHOPT_X86
+
+// The kernels below filter 4 elements per iteration with the arithmetic of the
+// scalar loops, in the same order and without FMA, so their output is bit
+// identical. They return the elements they filtered, the rest is left to the
+// scalar loops.
+
+// x and y of `n` unfolded and scaled to unit length times `max`, rounded like roundSigned()
+__attribute__((target("sse4.1"))) inline void unitOct(__m128i &x, __m128i &y, __m128i &z, float max) {
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 zero = _mm_setzero_ps();
+    __m128 fx = _mm_cvtepi32_ps(x);
+    __m128 fy = _mm_cvtepi32_ps(y);
+    __m128 fz = _mm_sub_ps(_mm_sub_ps(_mm_cvtepi32_ps(z), _mm_and_ps(fx, absMask)), _mm_and_ps(fy, absMask));
+
+    __m128 t = _mm_min_ps(fz, zero);
+    __m128 negT = _mm_sub_ps(zero, t);
+    fx = _mm_add_ps(fx, _mm_blendv_ps(negT, t, _mm_cmpge_ps(fx, zero)));
+    fy = _mm_add_ps(fy, _mm_blendv_ps(negT, t, _mm_cmpge_ps(fy, zero)));
+
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy)), _mm_mul_ps(fz, fz)));
+    __m128 scale = _mm_div_ps(_mm_set1_ps(max), length);
+    __m128 *values[3] = {&fx, &fy, &fz};
+    __m128i *out[3] = {&x, &y, &z};
+    for (int c = 0; c < 3; ++c) {
+        __m128 v = _mm_mul_ps(*values[c], scale);
+        __m128 half = _mm_blendv_ps(_mm_set1_ps(-0.5f), _mm_set1_ps(0.5f), _mm_cmpge_ps(v, zero));
+        *out[c] = _mm_cvttps_epi32(_mm_add_ps(v, half));
+    }
+}
+
+__attribute__((target("sse4.1"))) size_t decodeFilterOctSse41(int8_t *data, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 4));
+        __m128i x = _mm_srai_epi32(_mm_slli_epi32(n, 24), 24);
+        __m128i y = _mm_srai_epi32(_mm_slli_epi32(n, 16), 24);
+        __m128i z = _mm_srai_epi32(_mm_slli_epi32(n, 8), 24);
+        unitOct(x, y, z, 127.f);
+
+        const __m128i byte = _mm_set1_epi32(0xff);
+        __m128i out = _mm_and_si128(n, _mm_set1_epi32((int) 0xff000000));
+        out = _mm_or_si128(out, _mm_and_si128(x, byte));
+        out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(y, byte), 8));
+        out = _mm_or_si128(out, _mm_slli_epi32(_mm_and_si128(z, byte), 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i * 4), out);
+    }
+    return i;
+}
+
+// splits 4 elements of 4 int16 into their x|y and z|w halves, 32 bits per element
+__attribute__((target("sse4.1"))) inline void splitHalves(const int16_t *data, __m128i &xy, __m128i &zw) {
+    __m128 n0 = _mm_loadu_ps(reinterpret_cast<const float *>(data));
+    __m128 n1 = _mm_loadu_ps(reinterpret_cast<const float *>(data + 8));
+    xy = _mm_castps_si128(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(2, 0, 2, 0)));
+    zw = _mm_castps_si128(_mm_shuffle_ps(n0, n1, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+__attribute__((target("sse4.1"))) size_t decodeFilterOctSse41(int16_t *data, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i xy, zw;
+        splitHalves(data + i * 4, xy, zw);
+        __m128i x = _mm_srai_epi32(_mm_slli_epi32(xy, 16), 16);
+        __m128i y = _mm_srai_epi32(xy, 16);
+        __m128i z = _mm_srai_epi32(_mm_slli_epi32(zw, 16), 16);
+        unitOct(x, y, z, 32767.f);
+
+        const __m128i low = _mm_set1_epi32(0xffff);
+        xy = _mm_or_si128(_mm_and_si128(x, low), _mm_slli_epi32(y, 16));
+        zw = _mm_or_si128(_mm_and_si128(z, low), _mm_andnot_si128(low, zw));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i * 4), _mm_unpacklo_epi32(xy, zw));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i * 4 + 8), _mm_unpackhi_epi32(xy, zw));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) size_t decodeFilterQuatSse41(int16_t *data, size_t count) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 scale = _mm_set1_ps(1.f / std::sqrt(2.f));
+    const __m128 unit = _mm_set1_ps(32767.f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i xy, zw;
+        splitHalves(data + i * 4, xy, zw);
+        __m128i w = _mm_srai_epi32(zw, 16);
+        __m128 ss = _mm_div_ps(scale, _mm_cvtepi32_ps(_mm_or_si128(w, _mm_set1_epi32(3))));
+
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(xy, 16), 16)), ss);
+        __m128 y = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(xy, 16)), ss);
+        __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(zw, 16), 16)), ss);
+        __m128 ww = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 fw = _mm_sqrt_ps(_mm_max_ps(ww, zero));
+
+        __m128i r[3];
+        __m128 values[3] = {x, y, z};
+        for (int c = 0; c < 3; ++c) {
+            __m128 v = _mm_mul_ps(values[c], unit);
+            __m128 half = _mm_blendv_ps(_mm_set1_ps(-0.5f), _mm_set1_ps(0.5f), _mm_cmpge_ps(v, zero));
+            r[c] = _mm_cvttps_epi32(_mm_add_ps(v, half));
+        }
+        __m128i rw = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fw, unit), _mm_set1_ps(0.5f)));
+
+        // w, x, y, z as 4 int16 per element, rotated by the index of the dropped component below
+        const __m128i low = _mm_set1_epi32(0xffff);
+        __m128i wx = _mm_or_si128(_mm_and_si128(rw, low), _mm_slli_epi32(r[0], 16));
+        __m128i yz = _mm_or_si128(_mm_and_si128(r[1], low), _mm_slli_epi32(r[2], 16));
+        uint64_t out[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi32(wx, yz));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2), _mm_unpackhi_epi32(wx, yz));
+        for (int e = 0; e < 4; ++e) {
+            unsigned shift = (data[(i + e) * 4 + 3] & 3) * 16;
+            uint64_t v = shift ? out[e] << shift | out[e] >> (64 - shift) : out[e];
+            std::memcpy(data + (i + e) * 4, &v, 8);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) size_t decodeFilterExpSse41(uint32_t *data, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+        __m128i e = _mm_srai_epi32(v, 24);
+        __m128 power = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e, _mm_set1_epi32(127)), 23));
+        _mm_storeu_ps(reinterpret_cast<float *>(data + i), _mm_mul_ps(power, _mm_cvtepi32_ps(m)));
+    }
+    return i;
+}
+
+Kernel fastestKernel() {
+    static const Kernel kernel = __builtin_cpu_supports("sse4.1") ? KERNEL_SSE41 : KERNEL_SCALAR;
+    return kernel;
+}
+
+#else
+
+Kernel fastestKernel() {
+    return KERNEL_SCALAR;
+}
+
+#endif
+
+// reverses `filter` with `kernel`, the SIMD kernels hand their tail to the scalar loops
+void applyFilter(MeshoptFilter filter, unsigned char *data, size_t count, size_t stride, Kernel kernel) {
+    // bufferView offsets and strides are multiples of 4, so the casts are aligned
+    size_t done = 0;
+    switch (filter) {
+    case MESHOPT_FILTER_OCTAHEDRAL:
+        if (stride == 4) {
+            int8_t *values = reinterpret_cast<int8_t *>(data);
+#ifdef MESHOPT_X86
+            if (kernel >= KERNEL_SSE41) done = decodeFilterOctSse41(values, count);
+#endif
+            decodeFilterOct(values + done * 4, count - done);
+        } else {
+            int16_t *values = reinterpret_cast<int16_t *>(data);
+#ifdef MESHOPT_X86
+            if (kernel >= KERNEL_SSE41) done = decodeFilterOctSse41(values, count);
+#endif
+            decodeFilterOct(values + done * 4, count - done);
+        }
+        break;
+    case MESHOPT_FILTER_QUATERNION: {
+        int16_t *values = reinterpret_cast<int16_t *>(data);
+#ifdef MESHOPT_X86
+        if (kernel >= KERNEL_SSE41) done = decodeFilterQuatSse41(values, count);
+#endif
+        decodeFilterQuat(values + done * 4, count - done);
+        break;
+    }
+    case MESHOPT_FILTER_EXPONENTIAL: {
+        uint32_t *values = reinterpret_cast<uint32_t *>(data);
+        size_t components = count * stride / 4;
+#ifdef MESHOPT_X86
+        if (kernel >= KERNEL_SSE41) done = decodeFilterExpSse41(values, components);
+#endif
+        decodeFilterExp(values + done, components - done);
+        break;
+    }
+    default:
+        break;
+    }
+#ifndef MESHOPT_X86
+    (void) kernel;
+#endif
+}
+
+bool decodeJob(const DecodeJob &job) {
+    switch (job.mode) {
+    case MODE_ATTRIBUTES:
+        if (!decodeVertexBuffer(job.dst, job.count, job.stride, job.src, job.size)) return false;
+        decodeFilter(job.filter, job.dst, job.count, job.stride);
+        return true;
+    case MODE_TRIANGLES:
+        return decodeIndexBuffer(job.dst, job.count, job.stride, job.src, job.size);
+    default:
+        return decodeIndexSequence(job.dst, job.count, job.stride, job.src, job.size);
+    }
+}
+
+// decodes the jobs on `pool`, or on this thread without one
+bool decodeJobs(const std::vector<DecodeJob> &jobs, ThreadPool *pool, std::string &err) {
+    std::vector<char> decoded(jobs.size(), 0);
+    auto run = [&](size_t i) {
+        // every job writes a distinct range of its buffer
+        decoded[i] = decodeJob(jobs[i]);
+    };
+    if (pool) {
+        pool->parallelFor(jobs.size(), run);
+    } else {
+        for (size_t i = 0; i < jobs.size(); ++i) run(i);
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!decoded[i]) {
+            err += "malformed " + std::string(EXTENSION) + " data in bufferView " + std::to_string(jobs[i].view) + "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+size_t sizeProperty(const tinygltf::Value &object, const char *name) {
+    const tinygltf::Value &value = object.Get(name);
+    return value.IsNumber() ? (size_t) value.GetNumberAsDouble() : 0;
+}
+
+// reads the extension of bufferView `index` into `job` and the range of the
+// compressed bytes, the pointers are left to the caller. False with `err` set
+// for a malformed extension.
+bool readExtension(const tinygltf::Value &ext, int index, DecodeJob &job, int &source, size_t &offset,
+                   std::string &err) {
+    const std::string where = std::string(EXTENSION) + " of bufferView " + std::to_string(index);
+    source = ext.Get("buffer").IsNumber() ? ext.Get("buffer").GetNumberAsInt() : -1;
+    offset = sizeProperty(ext, "byteOffset");
+    job.view = index;
+    job.size = sizeProperty(ext, "byteLength");
+    job.stride = sizeProperty(ext, "byteStride");
+    job.count = sizeProperty(ext, "count");
+
+    const tinygltf::Value &mode = ext.Get("mode");
+    const std::string modeName = mode.IsString() ? mode.Get<std::string>() : "";
+    if (modeName == "ATTRIBUTES") {
+        job.mode = MODE_ATTRIBUTES;
+    } else if (modeName == "TRIANGLES") {
+        job.mode = MODE_TRIANGLES;
+    } else if (modeName == "INDICES") {
+        job.mode = MODE_INDICES;
+    } else {
+        err += where + " has unknown mode '" + modeName + "'\n";
+        return false;
+    }
+
+    const tinygltf::Value &filter = ext.Get("filter");
+    const std::string filterName = filter.IsString() ? filter.Get<std::string>() : "NONE";
+    if (filterName == "NONE") {
+        job.filter = MESHOPT_FILTER_NONE;
+    } else if (filterName == "OCTAHEDRAL") {
+        job.filter = MESHOPT_FILTER_OCTAHEDRAL;
+    } else if (filterName == "QUATERNION") {
+        job.filter = MESHOPT_FILTER_QUATERNION;
+    } else if (filterName == "EXPONENTIAL") {
+        job.filter = MESHOPT_FILTER_EXPONENTIAL;
+    } else {
+        err += where + " has unknown filter '" + filterName + "'\n";
+        return false;
+    }
+
+    bool strideOk;
+    switch (job.mode) {
+    case MODE_ATTRIBUTES:
+        strideOk = job.stride > 0 && job.stride <= 256 && job.stride % 4 == 0;
+        break;
+    case MODE_TRIANGLES:
+        strideOk = (job.stride == 2 || job.stride == 4) && job.count % 3 == 0;
+        break;
+    default:
+        strideOk = job.stride == 2 || job.stride == 4;
+        break;
+    }
+    bool filterOk = job.filter == MESHOPT_FILTER_NONE ||
+                    (job.mode == MODE_ATTRIBUTES &&
+                     (job.filter != MESHOPT_FILTER_OCTAHEDRAL || job.stride == 4 || job.stride == 8) &&
+                     (job.filter != MESHOPT_FILTER_QUATERNION || job.stride == 8));
+    if (!strideOk || !filterOk) {
+        err += where + " has an invalid byteStride, count or filter\n";
+        return false;
+    }
+    return true;
+}
+
+// one job per compressed view whose buffer is a fallback buffer, fallback
+// buffers get writable storage in Buffer::data
+bool collectJobs(LoadedModel &loaded, std::vector<DecodeJob> &jobs, std::string &err) {
+    tinygltf::Model &model = loaded.model;
+    for (size_t i = 0; i < model.buffers.size(); ++i) {
+        tinygltf::Buffer &buffer = model.buffers[i];
+        if (isMeshoptFallback(buffer) && loaded.bufferData[i] != buffer.data.data()) {
+            // a fallback buffer with a uri was mapped, its bytes are replaced anyway
+            buffer.data.assign(loaded.bufferSizes[i], 0);
+            loaded.bufferData[i] = buffer.data.data();
+        }
+    }
+
+    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+        const tinygltf::BufferView &view = model.bufferViews[i];
+        auto ext = view.extensions.find(EXTENSION);
+        if (ext == view.extensions.end()) continue;
+
+        DecodeJob job;
+        int source;
+        size_t offset;
+        if (!readExtension(ext->second, (int) i, job, source, offset, err)) return false;
+        if (view.buffer < 0 || view.buffer >= (int) model.buffers.size() || !isMeshoptFallback(model.buffers[view.buffer])) {
+            // the buffer holds the uncompressed bytes already
+            continue;
+        }
+
+        const std::string where = std::string(EXTENSION) + " of bufferView " + std::to_string(i);
+        if (source < 0 || source >= (int) model.buffers.size() || isMeshoptFallback(model.buffers[source]) ||
+            offset > loaded.bufferSizes[source] || job.size > loaded.bufferSizes[source] - offset) {
+            err += where + " reads outside its buffer\n";
+            return false;
+        }
+        size_t targetSize = loaded.bufferSizes[view.buffer];
+        if (job.count > view.byteLength / job.stride || view.byteOffset > targetSize ||
+            view.byteLength > targetSize - view.byteOffset) {
+            err += where + " decodes outside its bufferView\n";
+            return false;
+        }
+
+        job.src = loaded.buffer(source) + offset;
+        job.dst = model.buffers[view.buffer].data.data() + view.byteOffset;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// encoders for the benchmark's synthetic mesh, plain and without the
+// encoder's search for better byte groupings
+
+unsigned char zigzag8(unsigned char v) {
+    return (unsigned char) (((signed char) v >> 7) ^ (v << 1));
+}
+
+// bytes a group takes at `bits` per value, SIZE_MAX when it cannot be coded so
+size_t encodedGroupSize(const unsigned char *group, int bits) {
+    if (bits == 8) return BYTE_GROUP;
+    size_t size = BYTE_GROUP * bits / 8;
+    int escape = (1 << bits) - 1;
+    for (size_t i = 0; i < BYTE_GROUP; ++i) {
+        if (bits == 0 && group[i] != 0) return SIZE_MAX;
+        size += bits > 0 && group[i] >= escape;
+    }
+    return size;
+}
+
+void encodeGroup(const unsigned char *group, int bits, std::vector<unsigned char> &out) {
+    if (bits == 0) return;
+    if (bits == 8) {
+        out.insert(out.end(), group, group + BYTE_GROUP);
+        return;
+    }
+    int escape = (1 << bits) - 1;
+    size_t packed = out.size();
+    out.resize(packed + BYTE_GROUP * bits / 8, 0);
+    for (size_t i = 0; i < BYTE_GROUP; ++i) {
+        int code = std::min((int) group[i], escape);
+        out[packed + i * bits / 8] |= (unsigned char) (code << (8 - bits - (int) (i * bits) % 8));
+    }
+    for (size_t i = 0; i < BYTE_GROUP; ++i) {
+        if (group[i] >= escape) out.push_back(group[i]);
+    }
+}
+
+void encodeBytes(const unsigned char *deltas, size_t size, std::vector<unsigned char> &out) {
+    static const int BITS[4] = {0, 2, 4, 8};
+    size_t header = out.size();
+    out.resize(header + (size / BYTE_GROUP + 3) / 4, 0);
+    for (size_t i = 0; i < size; i += BYTE_GROUP) {
+        int best = 3;
+        for (int b = 0; b < 3; ++b) {
+            if (encodedGroupSize(deltas + i, BITS[b]) < encodedGroupSize(deltas + i, BITS[best])) best = b;
+        }
+        size_t group = i / BYTE_GROUP;
+        out[header + group / 4] |= (unsigned char) (best << ((group % 4) * 2));
+        encodeGroup(deltas + i, BITS[best], out);
+    }
+}
+
+void encodeVertexBuffer(const unsigned char *src, size_t count, size_t stride, std::vector<unsigned char> &out) {
+    out.assign(1, VERTEX_HEADER);
+    unsigned char last[256];
+    std::memcpy(last, src, stride);
+
+    unsigned char deltas[VERTEX_BLOCK_MAX];
+    size_t blockSize = vertexBlockSize(stride);
+    for (size_t offset = 0; offset < count; offset += blockSize) {
+        size_t n = std::min(blockSize, count - offset);
+        size_t alignedCount = (n + BYTE_GROUP - 1) & ~(BYTE_GROUP - 1);
+        for (size_t k = 0; k < stride; ++k) {
+            std::memset(deltas, 0, alignedCount);
+            unsigned char p = last[k];
+            for (size_t i = 0; i < n; ++i) {
+                unsigned char v = src[(offset + i) * stride + k];
+                deltas[i] = zigzag8((unsigned char) (v - p));
+                p = v;
+            }
+            encodeBytes(deltas, alignedCount, out);
+        }
+        std::memcpy(last, src + (offset + n - 1) * stride, stride);
+    }
+
+    size_t tailSize = std::max(stride, VERTEX_TAIL_MIN);
+    out.insert(out.end(), tailSize - stride, 0);
+    out.insert(out.end(), src, src + stride);
+}
+
+void encodeIndexSequence(const uint32_t *indices, size_t count, std::vector<unsigned char> &out) {
+    out.assign(1, SEQUENCE_HEADER | INDEX_VERSION_MAX);
+    uint32_t last[2] = {0, 0};
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t index = indices[i];
+        int64_t d0 = (int64_t) index - last[0], d1 = (int64_t) index - last[1];
+        uint32_t current = std::abs(d1) < std::abs(d0) ? 1 : 0;
+        uint32_t d = index - last[current];
+        uint32_t v = ((d << 1) ^ (uint32_t) ((int32_t) d >> 31)) << 1 | current;
+        while (v >= 128) {
+            out.push_back((unsigned char) ((v & 127) | 128));
+            v >>= 7;
+        }
+        out.push_back((unsigned char) v);
+        last[current] = index;
+    }
+    out.insert(out.end(), 4, 0);
+}
+
+// a height field of side x side vertices in the streams gltfpack writes: quantized
+// positions, octahedral normals, quantized uvs and a sequence of indices
+struct SyntheticMesh {
+    std::vector<unsigned char> positions, normals, uvs, indices;
+    std::vector<unsigned char> encoded[4];
+    std::vector<unsigned char> decoded[4];
+    std::vector<float> unitNormals;
+
+    explicit SyntheticMesh(int side) {
+        size_t count = (size_t) side * side;
+        positions.resize(count * 8);
+        normals.resize(count * 4);
+        uvs.resize(count * 4);
+        unitNormals.resize(count * 3);
+        for (int z = 0; z < side; ++z) {
+            for (int x = 0; x < side; ++x) {
+                size_t i = (size_t) z * side + x;
+                float fx = x * 0.05f, fz = z * 0.05f;
+                float height = std::sin(fx) * std::cos(fz);
+                uint16_t p[4] = {(uint16_t) (x * 64), (uint16_t) ((height + 1.f) * 16384.f), (uint16_t) (z * 64), 0};
+                std::memcpy(&positions[i * 8], p, 8);
+                uint16_t uv[2] = {(uint16_t) (x * 65535 / (side - 1)), (uint16_t) (z * 65535 / (side - 1))};
+                std::memcpy(&uvs[i * 4], uv, 4);
+
+                float n[3] = {-std::cos(fx) * std::cos(fz), 1.f, std::sin(fx) * std::sin(fz)};
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int c = 0; c < 3; ++c) unitNormals[i * 3 + c] = n[c] / length;
+                // octahedral projection, z keeps the value of 1.0
+                float s = 1.f / (std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]));
+                float u = n[0] * s, v = n[1] * s;
+                if (n[2] < 0.f) {
+                    float fu = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+                    float fv = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+                    u = fu;
+                    v = fv;
+                }
+                normals[i * 4 + 0] = (unsigned char) (int8_t) roundSigned(u * 127.f);
+                normals[i * 4 + 1] = (unsigned char) (int8_t) roundSigned(v * 127.f);
+                normals[i * 4 + 2] = 127;
+                normals[i * 4 + 3] = 0;
+            }
+        }
+
+        std::vector<uint32_t> list;
+        list.reserve((size_t) (side - 1) * (side - 1) * 6);
+        for (int z = 0; z + 1 < side; ++z) {
+            for (int x = 0; x + 1 < side; ++x) {
+                uint32_t i = (uint32_t) (z * side + x);
+                uint32_t quad[6] = {i, i + side, i + 1, i + 1, i + side, i + side + 1};
+                list.insert(list.end(), quad, quad + 6);
+            }
+        }
+        indices.resize(list.size() * 4);
+        std::memcpy(indices.data(), list.data(), indices.size());
+
+        encodeVertexBuffer(positions.data(), count, 8, encoded[0]);
+        encodeVertexBuffer(normals.data(), count, 4, encoded[1]);
+        encodeVertexBuffer(uvs.data(), count, 4, encoded[2]);
+        encodeIndexSequence(list.data(), list.size(), encoded[3]);
+        decoded[0].resize(positions.size());
+        decoded[1].resize(normals.size());
+        decoded[2].resize(uvs.size());
+        decoded[3].resize(indices.size());
+    }
+
+    std::vector<DecodeJob> jobs() {
+        size_t count = positions.size() / 8;
+        DecodeJob position = {0, encoded[0].data(), encoded[0].size(), decoded[0].data(), count, 8,
+                              MODE_ATTRIBUTES, MESHOPT_FILTER_NONE};
+        DecodeJob normal = {1, encoded[1].data(), encoded[1].size(), decoded[1].data(), count, 4,
+                            MODE_ATTRIBUTES, MESHOPT_FILTER_OCTAHEDRAL};
+        DecodeJob uv = {2, encoded[2].data(), encoded[2].size(), decoded[2].data(), count, 4,
+                        MODE_ATTRIBUTES, MESHOPT_FILTER_NONE};
+        DecodeJob index = {3, encoded[3].data(), encoded[3].size(), decoded[3].data(), indices.size() / 4, 4,
+                           MODE_INDICES, MESHOPT_FILTER_NONE};
+        return {position, normal, uv, index};
+    }
+
+    // the decoded streams against the source, normals within the octahedral error
+    bool verify() const {
+        if (decoded[0] != positions || decoded[2] != uvs || decoded[3] != indices) return false;
+        for (size_t i = 0; i < unitNormals.size() / 3; ++i) {
+            float dot = 0.f;
+            for (int c = 0; c < 3; ++c) dot += (int8_t) decoded[1][i * 4 + c] / 127.f * unitNormals[i * 3 + c];
+            if (dot < 0.99f) return false;
+        }
+        return true;
+    }
+};
+
+// index streams assembled by hand from the bitstream description, with the
+// indices they decode to. They were not written by gltfpack or meshoptimizer,
+// no output of either was available to this tree.
+const unsigned char REFERENCE_TRIANGLES_V0[] = {
+    0xe0, 0xf0, 0x10, 0xfe, 0xff, 0xf0, 0x0c, 0xff, 0x02, 0x02, 0x02, 0x00, 0x76, 0x87, 0x56, 0x67,
+    0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+};
+const uint32_t REFERENCE_TRIANGLES_V0_INDICES[] = {0, 1, 2, 2, 1, 3, 4, 6, 5, 7, 8, 9};
+
+// version 1: a restart (0xfe 0x00) and the +-1 codes
+const unsigned char REFERENCE_TRIANGLES_V1[] = {
+    0xe1, 0xf0, 0x10, 0xfe, 0x1f, 0x3d, 0x00, 0x0a, 0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86,
+    0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00,
+};
+const uint32_t REFERENCE_TRIANGLES_V1_INDICES[] = {0, 1, 2, 2, 1, 3, 0, 1, 2, 2, 1, 5, 2, 1, 4};
+
+const unsigned char REFERENCE_SEQUENCE_V1[] = {
+    0xd1, 0x00, 0x04, 0xcd, 0x01, 0x04, 0x07, 0x98, 0x1f, 0x00, 0x00, 0x00, 0x00,
+};
+const uint32_t REFERENCE_SEQUENCE_V1_INDICES[] = {0, 1, 51, 2, 49, 1000};
+
+template <size_t N, size_t M>
+bool matchesReference(const unsigned char (&src)[N], const uint32_t (&expected)[M], bool sequence) {
+    uint32_t indices[M];
+    bool ok = sequence ? decodeIndexSequence((unsigned char *) indices, M, 4, src, N)
+                       : decodeIndexBuffer((unsigned char *) indices, M, 4, src, N);
+    return ok && std::equal(indices, indices + M, expected);
+}
+
+// the hand-assembled streams decode to their indices, as 32 and 16 bit
+bool referenceStreamsMatch() {
+    uint16_t shortIndices[12];
+    bool shortOk = decodeIndexBuffer((unsigned char *) shortIndices, 12, 2, REFERENCE_TRIANGLES_V0,
+                                     sizeof(REFERENCE_TRIANGLES_V0)) &&
+                   std::equal(shortIndices, shortIndices + 12, REFERENCE_TRIANGLES_V0_INDICES);
+    return shortOk && matchesReference(REFERENCE_TRIANGLES_V0, REFERENCE_TRIANGLES_V0_INDICES, false) &&
+           matchesReference(REFERENCE_TRIANGLES_V1, REFERENCE_TRIANGLES_V1_INDICES, false) &&
+           matchesReference(REFERENCE_SEQUENCE_V1, REFERENCE_SEQUENCE_V1_INDICES, true);
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// times every filter on `count` random elements with the scalar loops and the
+// fastest kernel and checks that both write the same bytes
+void benchmarkFilters(size_t count, int runs) {
+    struct Case {
+        const char *name;
+        MeshoptFilter filter;
+        size_t stride;
+    };
+    const Case cases[] = {
+        {"octahedral 8-bit", MESHOPT_FILTER_OCTAHEDRAL, 4},
+        {"octahedral 16-bit", MESHOPT_FILTER_OCTAHEDRAL, 8},
+        {"quaternion", MESHOPT_FILTER_QUATERNION, 8},
+        {"exponential", MESHOPT_FILTER_EXPONENTIAL, 4},
+    };
+    Kernel fastest = fastestKernel();
+    std::cout << "filters, " << (fastest == KERNEL_SSE41 ? "SSE4.1" : "no SIMD") << " kernel:" << std::endl;
+
+    for (const Case &c : cases) {
+        // odd count, so the scalar tail is part of every run
+        std::vector<unsigned char> source(count * c.stride);
+        uint32_t state = 0x9e3779b9;
+        for (unsigned char &byte : source) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            byte = (unsigned char) state;
+        }
+
+        std::vector<unsigned char> results[2];
+        double best[2] = {0.0, 0.0};
+        const Kernel kernels[2] = {KERNEL_SCALAR, fastest};
+        for (int k = 0; k < 2; ++k) {
+            for (int i = 0; i < runs; ++i) {
+                results[k] = source;
+                auto start = std::chrono::steady_clock::now();
+                applyFilter(c.filter, results[k].data(), count, c.stride, kernels[k]);
+                double ms = msSince(start);
+                best[k] = i == 0 ? ms : std::min(best[k], ms);
+            }
+        }
+        double megabytes = source.size() / (1024.0 * 1024.0);
+        std::cout << "  " << c.name << ": scalar " << megabytes / (best[0] / 1000.0) << " MB/s, kernel "
+                  << megabytes / (best[1] / 1000.0) << " MB/s, " << (results[0] == results[1] ? "identical" : "MISMATCH")
+                  << std::endl;
+    }
+}
+}
+
+
+bool decodeVertexBuffer(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size) {
+    if (stride == 0 || stride > 256 || stride % 4 != 0) return false;
+    if (size < 1 || src[0] != VERTEX_HEADER) return false;
+
+    const unsigned char *data = src + 1;
+    const unsigned char *end = src + size;
+    size_t tailSize = std::max(stride, VERTEX_TAIL_MIN);
+    if ((size_t) (end - data) < tailSize) return false;
+
+    // the tail holds the first vertex, deltas of the first block are taken against it
+    unsigned char last[256];
+    std::memcpy(last, end - stride, stride);
+
+    size_t blockSize = vertexBlockSize(stride);
+    for (size_t offset = 0; offset < count; offset += blockSize) {
+        size_t n = std::min(blockSize, count - offset);
+        data = decodeVertexBlock(data, end, dst + offset * stride, n, stride, last);
+        if (!data) return false;
+    }
+    return (size_t) (end - data) == tailSize;
+}
+
+bool decodeIndexBuffer(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size) {
+    if (count % 3 != 0 || (stride != 2 && stride != 4)) return false;
+    // header, one code per triangle and the 16 byte table of auxiliary codes
+    if (size < 1 + count / 3 + 16) return false;
+    if ((src[0] & 0xf0) != INDEX_HEADER || (src[0] & 0x0f) > INDEX_VERSION_MAX) return false;
+    // version 1 takes fifo codes 13 and 14 for the last free index -1 and +1
+    int fecMax = (src[0] & 0x0f) >= 1 ? 13 : 15;
+
+    uint32_t edgeFifo[16][2];
+    uint32_t vertexFifo[16];
+    std::memset(edgeFifo, -1, sizeof(edgeFifo));
+    std::memset(vertexFifo, -1, sizeof(vertexFifo));
+    size_t edgeOffset = 0, vertexOffset = 0;
+    uint32_t next = 0, last = 0;
+
+    const unsigned char *code = src + 1;
+    const unsigned char *data = code + count / 3;
+    // a triangle reads at most 16 bytes, the table at the end keeps reads in bounds
+    const unsigned char *dataSafeEnd = src + size - 16;
+    const unsigned char *codeauxTable = dataSafeEnd;
+
+    for (size_t i = 0; i < count; i += 3) {
+        if (data > dataSafeEnd) return false;
+        unsigned char codetri = *code++;
+
+        if (codetri < 0xf0) {
+            // the triangle shares an edge from the fifo, the high nibble picks it
+            int fe = codetri >> 4;
+            uint32_t a = edgeFifo[(edgeOffset - 1 - fe) & 15][0];
+            uint32_t b = edgeFifo[(edgeOffset - 1 - fe) & 15][1];
+
+            // the low nibble codes the third vertex: next, a fifo entry, a step from the
+            // last free index or a free index
+            int fec = codetri & 15;
+            if (fec < fecMax) {
+                uint32_t c = fec == 0 ? next : vertexFifo[(vertexOffset - 1 - fec) & 15];
+                int fec0 = fec == 0;
+                next += fec0;
+                writeTriangle(dst, i, stride, a, b, c);
+                pushVertexFifo(vertexFifo, c, vertexOffset, fec0);
+                pushEdgeFifo(edgeFifo, c, b, edgeOffset);
+                pushEdgeFifo(edgeFifo, a, c, edgeOffset);
+            } else {
+                // fec - (fec ^ 3) maps 13 and 14 to -1 and +1
+                uint32_t c = last = fec != 15 ? last + (uint32_t) (fec - (fec ^ 3)) : decodeIndex(data, last);
+                writeTriangle(dst, i, stride, a, b, c);
+                pushVertexFifo(vertexFifo, c, vertexOffset);
+                pushEdgeFifo(edgeFifo, c, b, edgeOffset);
+                pushEdgeFifo(edgeFifo, a, c, edgeOffset);
+            }
+        } else if (codetri < 0xfe) {
+            // a is next, b and c come from the table entry the low nibble selects
+            unsigned char codeaux = codeauxTable[codetri & 15];
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            // next advances for every vertex before the fifo is read, as the encoder does
+            uint32_t a = next++;
+            uint32_t b = feb == 0 ? next : vertexFifo[(vertexOffset - feb) & 15];
+            int feb0 = feb == 0;
+            next += feb0;
+            uint32_t c = fec == 0 ? next : vertexFifo[(vertexOffset - fec) & 15];
+            int fec0 = fec == 0;
+            next += fec0;
+
+            writeTriangle(dst, i, stride, a, b, c);
+            pushVertexFifo(vertexFifo, a, vertexOffset);
+            pushVertexFifo(vertexFifo, b, vertexOffset, feb0);
+            pushVertexFifo(vertexFifo, c, vertexOffset, fec0);
+            pushEdgeFifo(edgeFifo, b, a, edgeOffset);
+            pushEdgeFifo(edgeFifo, c, b, edgeOffset);
+            pushEdgeFifo(edgeFifo, a, c, edgeOffset);
+        } else {
+            // the auxiliary code follows in the data, a is next for 0xfe and free for 0xff
+            unsigned char codeaux = *data++;
+            // 0xfe 0x00 never comes from a version 0 encoder, version 1 restarts next with it
+            if (codetri == 0xfe && codeaux == 0) next = 0;
+            int fea = codetri == 0xfe ? 0 : 15;
+            int feb = codeaux >> 4;
+            int fec = codeaux & 15;
+
+            uint32_t a = fea == 0 ? next++ : 0;
+            uint32_t b = feb == 0 ? next++ : vertexFifo[(vertexOffset - feb) & 15];
+            uint32_t c = fec == 0 ? next++ : vertexFifo[(vertexOffset - fec) & 15];
+            if (fea == 15) last = a = decodeIndex(data, last);
+            if (feb == 15) last = b = decodeIndex(data, last);
+            if (fec == 15) last = c = decodeIndex(data, last);
+
+            writeTriangle(dst, i, stride, a, b, c);
+            pushVertexFifo(vertexFifo, a, vertexOffset);
+            pushVertexFifo(vertexFifo, b, vertexOffset, (feb == 0) | (feb == 15));
+            pushVertexFifo(vertexFifo, c, vertexOffset, (fec == 0) | (fec == 15));
+            pushEdgeFifo(edgeFifo, b, a, edgeOffset);
+            pushEdgeFifo(edgeFifo, c, b, edgeOffset);
+            pushEdgeFifo(edgeFifo, a, c, edgeOffset);
+        }
+    }
+    // all data is read exactly up to the table
+    return data == dataSafeEnd;
+}
+
+bool decodeIndexSequence(unsigned char *dst, size_t count, size_t stride, const unsigned char *src, size_t size) {
+    if (stride != 2 && stride != 4) return false;
+    // header, at least one byte per index and a 4 byte tail
+    if (size < 1 + count + 4) return false;
+    // both versions code sequences the same way
+    if ((src[0] & 0xf0) != SEQUENCE_HEADER || (src[0] & 0x0f) > INDEX_VERSION_MAX) return false;
+
+    const unsigned char *data = src + 1;
+    // an index reads at most 5 bytes, the tail keeps reads in bounds
+    const unsigned char *dataSafeEnd = src + size - 4;
+    // two baselines, the lowest bit of every code picks the one its delta applies to
+    uint32_t last[2] = {0, 0};
+
+    for (size_t i = 0; i < count; ++i) {
+        if (data >= dataSafeEnd) return false;
+        uint32_t v = decodeVByte(data);
+        uint32_t current = v & 1;
+        v >>= 1;
+        uint32_t d = (v >> 1) ^ (uint32_t) -(int32_t) (v & 1);
+        uint32_t index = last[current] + d;
+        last[current] = index;
+        writeIndex(dst, i, stride, index);
+    }
+    return data == dataSafeEnd;
+}
+
+void decodeFilter(MeshoptFilter filter, unsigned char *data, size_t count, size_t stride) {
+    applyFilter(filter, data, count, stride, fastestKernel());
+}
+
+bool isMeshoptFallback(const tinygltf::Buffer &buffer) {
+    auto ext = buffer.extensions.find(EXTENSION);
+    if (ext == buffer.extensions.end()) return false;
+    const tinygltf::Value &fallback = ext->second.Get("fallback");
+    return fallback.IsBool() && fallback.Get<bool>();
+}
+
+bool decodeMeshopt(LoadedModel &loaded, unsigned int threads, std::string &err) {
+    std::vector<DecodeJob> jobs;
+    if (!collectJobs(loaded, jobs, err)) return false;
+    if (jobs.empty()) return true;
+
+    loadreport::Stage stage("decode meshopt");
+    if (jobs.size() == 1) return decodeJobs(jobs, nullptr, err);
+    ThreadPool pool(threads);
+    return decodeJobs(jobs, &pool, err);
+}
+
+void benchmarkMeshopt(const std::string &filename, const LoadOptions &options, int runs) {
+    LoadOptions opts = options;
+    opts.verbose = false;
+    opts.decodeImages = false;
+    opts.progressive = false;
+
+    LoadedModel loaded;
+    std::vector<DecodeJob> jobs;
+    std::string err;
+    if (loadModel(loaded, filename, opts) && !collectJobs(loaded, jobs, err)) {
+        std::cout << "ERR: " << err << std::endl;
+        return;
+    }
+
+    std::unique_ptr<SyntheticMesh> mesh;
+    if (jobs.empty()) {
+        mesh.reset(new SyntheticMesh(1024));
+        jobs = mesh->jobs();
+        std::cout << "no " << EXTENSION << " views in " << filename << ", decoding a synthetic 1024x1024 grid"
+                  << std::endl;
+    }
+
+    size_t encodedBytes = 0, decodedBytes = 0;
+    for (const DecodeJob &job : jobs) {
+        encodedBytes += job.size;
+        decodedBytes += job.count * job.stride;
+    }
+    std::cout << jobs.size() << " views, " << encodedBytes / (1024.0 * 1024.0) << " MB compressed, "
+              << decodedBytes / (1024.0 * 1024.0) << " MB decoded" << std::endl;
+
+    auto measure = [&](const char *name, ThreadPool *pool) {
+        double best = 0.0, total = 0.0;
+        for (int i = 0; i < runs; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            if (!decodeJobs(jobs, pool, err)) {
+                std::cout << "ERR: " << err << std::endl;
+                return;
+            }
+            double ms = msSince(start);
+            best = i == 0 ? ms : std::min(best, ms);
+            total += ms;
+        }
+        std::cout << name << ": best " << best << " ms, mean " << total / runs << " ms, "
+                  << decodedBytes / (1024.0 * 1024.0) / (best / 1000.0) << " MB/s over " << runs << " runs"
+                  << std::endl;
+    };
+
+    measure("one thread", nullptr);
+    ThreadPool pool(options.threads == 1 ? 0 : options.threads);
+    std::string name = "thread pool (" + std::to_string(pool.size()) + " threads)";
+    measure(name.c_str(), &pool);
+
+    if (mesh) {
+        std::cout << "round trip: " << (mesh->verify() ? "ok" : "MISMATCH") << std::endl;
+    }
+    std::cout << "hand-assembled index streams: " << (referenceStreamsMatch() ? "ok" : "MISMATCH") << std::endl;
+    benchmarkFilters((1u << 20) + 3, runs);
+}
@@ -0,0 +1,473 @@
+#include "include/scene.h"
+#include "include/buffer_arena.h"
+#include "include/load_report.h"
+#include "include/staging_ring.h"
+#include "include/texture.h"
+#include "include/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <glm/geometric.hpp>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <tuple>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+
+// largest arena page, bigger scenes are spread over several pages
+const size_t MAX_ARENA_PAGE = 256u << 20;
+// staging memory geometry is copied through, larger ranges are uploaded directly
+const size_t STAGING_RING_SIZE = 32u << 20;
+
+// Packs every primitive into arena ranges: vertices interleaved into one arena
+// per vertex layout, indices into a single index arena. Accessors shared by
+// several primitives are packed once. The arenas are sized by a first pass
+// over all primitives, so a scene normally needs one page per layout.
+class GeometryPacker
+{
+public:
+    GeometryPacker(RenderScene &scene, LoadedModel &loaded)
+        : scene(scene), loaded(loaded), ring(STAGING_RING_SIZE), pool(loaded.threads) {}
+
+    // first pass, counts the bytes `primitive` will take
+    void reserve(const tinygltf::Primitive &primitive) {
+        std::vector<int> accessors;
+        int layout = primitiveLayout(primitive, accessors);
+        if (layout < 0) return;
+
+        const tinygltf::Model &model = loaded.model;
+        if (vertexReserved.insert(accessors).second) {
+            vertexBytes[layout] += model.accessors[accessors[0]].count * scene.layouts[layout].stride
+                                   + scene.layouts[layout].stride;
+        }
+        if (indexReserved.insert(primitive.indices).second) {
+            const tinygltf::Accessor &indices = model.accessors[primitive.indices];
+            indexBytes += indices.count * tinygltf::GetComponentSizeInBytes(indices.componentType) + 4;
+        }
+    }
+
+    // second pass, uploads the vertices and indices of `primitive` and fills in their location
+    bool pack(const tinygltf::Primitive &primitive, DrawItem &item) {
+        std::vector<int> accessors;
+        int layout = primitiveLayout(primitive, accessors);
+        if (layout < 0) {
+            skipped++;
+            return false;
+        }
+        const tinygltf::Model &model = loaded.model;
+        const VertexLayout &vertexLayout = scene.layouts[layout];
+
+        auto vertices = vertexRanges.find(accessors);
+        if (vertices == vertexRanges.end()) {
+            size_t count = model.accessors[accessors[0]].count;
+            // a multiple of the stride, so the offset is a whole number of vertices
+            ArenaRange range = arena(layout).allocate(count * vertexLayout.stride, vertexLayout.stride);
+
+            // where each attribute comes from, the interleaving itself runs on the pool
+            struct Stream {
+                const unsigned char *src;
+                size_t srcStride;
+                size_t elementSize;
+                size_t offset;
+            };
+            std::vector<Stream> streams;
+            for (size_t a = 0; a < accessors.size(); ++a) {
+                const tinygltf::Accessor &accessor = model.accessors[accessors[a]];
+                const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+                Stream stream;
+                stream.src = loaded.buffer(bufferView.buffer) + bufferView.byteOffset + accessor.byteOffset;
+                stream.srcStride = accessor.ByteStride(bufferView);
+                stream.elementSize = tinygltf::GetComponentSizeInBytes(accessor.componentType)
+                                     * tinygltf::GetNumComponentsInType(accessor.type);
+                stream.offset = vertexLayout.attribs[a].offset;
+                streams.push_back(stream);
+            }
+            size_t stride = vertexLayout.stride;
+            stage(range, count * stride, [streams, count, stride](unsigned char *dst) {
+                for (const Stream &stream : streams) {
+                    for (size_t v = 0; v < count; ++v) {
+                        std::memcpy(dst + v * stride + stream.offset, stream.src + v * stream.srcStride,
+                                    stream.elementSize);
+                    }
+                }
+            });
+
+            packedBytes += count * stride;
+            for (const VertexAttrib &va : vertexLayout.attribs) floatBytes += count * va.size * sizeof(float);
+
+            GLint baseVertex = (GLint) (range.offset / vertexLayout.stride);
+            vertices = vertexRanges.insert(std::make_pair(accessors, std::make_pair(range.buffer, baseVertex))).first;
+        }
+
+        auto indices = indexRanges.find(primitive.indices);
+        if (indices == indexRanges.end()) {
+            const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+            const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+            size_t indexSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            size_t size = accessor.count * indexSize;
+            // glDrawElements wants indices aligned to their size
+            ArenaRange range = indexArena().allocate(size, std::max<size_t>(indexSize, 4));
+            const unsigned char *src = loaded.buffer(bufferView.buffer) + bufferView.byteOffset + accessor.byteOffset;
+            stage(range, size, [src, size](unsigned char *dst) { std::memcpy(dst, src, size); });
+            indices = indexRanges.insert(std::make_pair(primitive.indices, range)).first;
+        }
+
+        const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+        item.vao = 0;
+        item.mode = primitive.mode;
+        item.count = indexAccessor.count;
+        item.indexType = indexAccessor.componentType;
+        item.indexOffset = indices->second.offset;
+        item.indexBuffer = indices->second.buffer;
+        item.baseVertex = vertices->second.second;
+        item.vertexBuffer = vertices->second.first;
+        item.layout = layout;
+        return true;
+    }
+
+    // uploads what is still queued and waits until the GPU has copied it
+    void finish() {
+        flush();
+        ring.finish();
+    }
+
+    void printStats() const {
+        size_t pages = index ? index->pageCount() : 0;
+        for (const auto &arena : arenas) pages += arena.second->pageCount();
+        std::cout << "geometry: " << vertexRanges.size() << " vertex and " << indexRanges.size()
+                  << " index ranges in " << pages << " buffers, " << scene.layouts.size()
+                  << " vertex layouts" << std::endl;
+        // quantized attributes stay quantized, this is what they would take as floats
+        std::cout << "vertex data: " << packedBytes / (1024.0 * 1024.0) << " MB, "
+                  << floatBytes / (1024.0 * 1024.0) << " MB as float" << std::endl;
+        if (skipped > 0) {
+            std::cout << skipped << " primitives without indices or POSITION skipped" << std::endl;
+        }
+        for (const std::string &name : missing) {
+            std::cout << "vaa missing: " << name << std::endl;
+        }
+    }
+
+private:
+    // index into scene.layouts of the attributes the shaders read from `primitive`,
+    // -1 when it cannot be drawn. `accessors` receives them in layout order.
+    int primitiveLayout(const tinygltf::Primitive &primitive, std::vector<int> &accessors) {
+        const tinygltf::Model &model = loaded.model;
+        if (primitive.indices < 0 || primitive.attributes.find("POSITION") == primitive.attributes.end()) {
+            return -1;
+        }
+
+        // attribute locations of the shaders
+        static const char *names[] = {"POSITION", "NORMAL", "TEXCOORD_0"};
+        VertexLayout layout;
+        layout.stride = 0;
+        accessors.clear();
+        for (GLuint location = 0; location < 3; ++location) {
+            auto attrib = primitive.attributes.find(names[location]);
+            if (attrib == primitive.attributes.end()) continue;
+            const tinygltf::Accessor &accessor = model.accessors[attrib->second];
+
+            VertexAttrib va;
+            va.location = location;
+            va.size = tinygltf::GetNumComponentsInType(accessor.type);
+            va.type = accessor.componentType;
+            va.normalized = accessor.normalized ? GL_TRUE : GL_FALSE;
+            va.offset = layout.stride;
+            layout.attribs.push_back(va);
+            accessors.push_back(attrib->second);
+
+            // every attribute starts 4-byte aligned
+            GLsizei size = va.size * tinygltf::GetComponentSizeInBytes(accessor.componentType);
+            layout.stride += (size + 3) & ~3;
+        }
+        for (const auto &attrib : primitive.attributes) {
+            if (attrib.first != names[0] && attrib.first != names[1] && attrib.first != names[2]) {
+                missing.insert(attrib.first);
+            }
+        }
+
+        for (size_t i = 0; i < scene.layouts.size(); ++i) {
+            if (scene.layouts[i] == layout) return (int) i;
+        }
+        scene.layouts.push_back(layout);
+        return (int) scene.layouts.size() - 1;
+    }
+
+    BufferArena &arena(int layout) {
+        std::unique_ptr<BufferArena> &arena = arenas[layout];
+        if (!arena) arena.reset(new BufferArena(scene, std::min(vertexBytes[layout], MAX_ARENA_PAGE)));
+        return *arena;
+    }
+
+    BufferArena &indexArena() {
+        if (!index) index.reset(new BufferArena(scene, std::min(indexBytes, MAX_ARENA_PAGE)));
+        return *index;
+    }
+
+    // queues a copy into `range`, `fill` writes the bytes into staging memory on a worker thread
+    void stage(const ArenaRange &range, size_t size, std::function<void(unsigned char *)> fill) {
+        loadreport::addUploaded("geometry", "arena " + std::to_string(range.buffer), size, 0.0);
+        UploadJob job;
+        if (!ring.allocate(size, job.region)) {
+            flush();
+            if (!ring.allocate(size, job.region)) {
+                // larger than the whole ring, filled here and uploaded directly
+                loadreport::Stage stage("buffer upload");
+                std::vector<unsigned char> bytes(size);
+                fill(bytes.data());
+                glBindBuffer(GL_ARRAY_BUFFER, range.buffer);
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) range.offset, (GLsizeiptr) size, bytes.data());
+                return;
+            }
+        }
+        job.range = range;
+        job.size = size;
+        job.fill = std::move(fill);
+        jobs.push_back(std::move(job));
+    }
+
+    // fills the queued regions in parallel, then copies them out and fences the batch
+    void flush() {
+        loadreport::Stage stage("buffer upload");
+        pool.parallelFor(jobs.size(), [this](size_t i) { jobs[i].fill(jobs[i].region.data); });
+        for (const UploadJob &job : jobs) {
+            ring.copy(job.region, job.range.buffer, job.range.offset, job.size);
+        }
+        ring.fence();
+        jobs.clear();
+    }
+
+    struct UploadJob {
+        StagingRing::Region region;
+        ArenaRange range;
+        size_t size;
+        std::function<void(unsigned char *)> fill;
+    };
+
+    RenderScene &scene;
+    LoadedModel &loaded;
+
+    std::map<int, size_t> vertexBytes;
+    size_t indexBytes = 0;
+    size_t packedBytes = 0;
+    size_t floatBytes = 0;
+    std::set<std::vector<int>> vertexReserved;
+    std::set<int> indexReserved;
+
+    std::map<int, std::unique_ptr<BufferArena>> arenas;
+    std::unique_ptr<BufferArena> index;
+    // attribute accessors -> buffer and base vertex, index accessor -> range
+    std::map<std::vector<int>, std::pair<GLuint, GLint>> vertexRanges;
+    std::map<int, ArenaRange> indexRanges;
+
+    StagingRing ring;
+    ThreadPool pool;
+    std::vector<UploadJob> jobs;
+
+    // attributes no shader reads and primitives that cannot be drawn, reported by printStats()
+    std::set<std::string> missing;
+    int skipped = 0;
+};
+
+// largest stored value of a normalized integer component, the one GL maps to 1.0
+float normalizedMax(int componentType) {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: return 127.0f;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return 255.0f;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: return 32767.0f;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return 65535.0f;
+    default: return 1.0f;
+    }
+}
+
+// KHR_texture_transform as one matrix, translation * rotation * scale. Quantized
+// texcoords that are not normalized rely on it to get back to the 0..1 range.
+glm::mat3 textureTransform(const tinygltf::TextureInfo &info) {
+    auto ext = info.extensions.find("KHR_texture_transform");
+    if (ext == info.extensions.end()) return glm::mat3(1.0f);
+    const tinygltf::Value &transform = ext->second;
+
+    glm::vec2 offset(0.0f), scale(1.0f);
+    float rotation = 0.0f;
+    if (transform.Has("offset") && transform.Get("offset").ArrayLen() == 2) {
+        offset = glm::vec2(transform.Get("offset").Get(0).GetNumberAsDouble(),
+                           transform.Get("offset").Get(1).GetNumberAsDouble());
+    }
+    if (transform.Has("scale") && transform.Get("scale").ArrayLen() == 2) {
+        scale = glm::vec2(transform.Get("scale").Get(0).GetNumberAsDouble(),
+                          transform.Get("scale").Get(1).GetNumberAsDouble());
+    }
+    if (transform.Has("rotation")) {
+        rotation = (float) transform.Get("rotation").GetNumberAsDouble();
+    }
+
+    // glm is column major
+    float c = std::cos(rotation), s = std::sin(rotation);
+    glm::mat3 t(1.0f), r(1.0f), sc(1.0f);
+    t[2] = glm::vec3(offset, 1.0f);
+    r[0] = glm::vec3(c, -s, 0.0f);
+    r[1] = glm::vec3(s, c, 0.0f);
+    sc[0][0] = scale.x;
+    sc[1][1] = scale.y;
+    return t * r * sc;
+}
+
+void bindMesh(RenderScene &scene, LoadedModel &loaded, GeometryPacker &geometry, TextureCache &textures,
+              const tinygltf::Mesh &mesh, size_t primitiveIndex, const glm::mat4 &modelMatrix) {
+    tinygltf::Model &model = loaded.model;
+    const tinygltf::Primitive &primitive = mesh.primitives[primitiveIndex];
+
+    DrawItem item;
+    if (!geometry.pack(primitive, item)) return;
+
+    // glTF requires min and max on POSITION, the sphere around that box bounds the primitive
+    const tinygltf::Accessor &position = model.accessors[primitive.attributes.at("POSITION")];
+    item.localCenter = glm::vec3(0.0f);
+    item.localRadius = 0.0f;
+    if (position.minValues.size() >= 3 && position.maxValues.size() >= 3) {
+        glm::vec3 lo(position.minValues[0], position.minValues[1], position.minValues[2]);
+        glm::vec3 hi(position.maxValues[0], position.maxValues[1], position.maxValues[2]);
+        // quantized positions are dequantized by the node transform. Bounds of normalized
+        // ones may still be given as the stored integers, GL reads those as -1..1 or 0..1.
+        glm::vec3 extent = glm::max(glm::abs(lo), glm::abs(hi));
+        if (position.normalized && std::max(extent.x, std::max(extent.y, extent.z)) > 1.0f) {
+            float unit = normalizedMax(position.componentType);
+            lo /= unit;
+            hi /= unit;
+        }
+        item.localCenter = (lo + hi) * 0.5f;
+        item.localRadius = glm::length(hi - lo) * 0.5f;
+    }
+    item.setModel(modelMatrix);
+
+    // primitives without a material use the glTF default one
+    static const tinygltf::Material defaultMaterial;
+    const tinygltf::Material &material = primitive.material >= 0 && primitive.material < (int) model.materials.size()
+                                         ? model.materials[primitive.material] : defaultMaterial;
+
+    const std::vector<double> &basecolorFactor = material.pbrMetallicRoughness.baseColorFactor;
+    item.material.basecolor = glm::vec3(basecolorFactor[0], basecolorFactor[1], basecolorFactor[2]);
+
+    int texIndex = material.pbrMetallicRoughness.baseColorTexture.index;
+    // a KHR_texture_basisu texture without fallback has no source when its KTX2 image could not be read
+    if (texIndex != -1 && model.textures[texIndex].source >= 0) {
+        item.material.baseColorSampler = textures.sampler(scene, texIndex);
+        item.material.uvTransform = textureTransform(material.pbrMetallicRoughness.baseColorTexture);
+        int image = model.textures[texIndex].source;
+        if (model.images[image].image.empty() && !loaded.compressed(image)) {
+            // not decoded yet, the base color stands in until the texture streams in
+            scene.pendingTextures.push_back(std::make_pair(scene.draws.size(), texIndex));
+        } else {
+            item.material.baseColorId = textures.texture(scene, texIndex);
+        }
+    }
+
+    scene.draws.push_back(std::move(item));
+}
+
+// mesh drawn by a node, null for nodes without one
+const tinygltf::Mesh *nodeMesh(const tinygltf::Model &model, int node) {
+    int mesh = model.nodes[node].mesh;
+    return mesh >= 0 && mesh < (int) model.meshes.size() ? &model.meshes[mesh] : nullptr;
+}
+
+void bindLights(RenderScene &scene, const tinygltf::Model &model) {
+    const SceneGraph &graph = scene.graph;
+    for (size_t e = 0; e < graph.size(); ++e) {
+        const tinygltf::Node &node = model.nodes[graph.nodes[e]];
+        auto ext = node.extensions.find("KHR_lights_punctual");
+        if (ext == node.extensions.end()) continue;
+
+        int lightId = ext->second.Get("light").GetNumberAsInt();
+        if (lightId < 0 || lightId >= (int) model.lights.size()) continue;
+        const tinygltf::Light &light = model.lights[lightId];
+
+        // skip directional light
+        if (light.type != "point") continue;
+
+        PointLight pointLight;
+        // TODO @mswamy check: do we need perspective divide here?
+        pointLight.position = graph.world[e] * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        pointLight.color = glm::vec3(light.color[0], light.color[1], light.color[2]);
+        scene.lights.push_back(pointLight);
+    }
+}
+
+RenderScene bindModel(LoadedModel &loaded) {
+    loadreport::Stage stage("bind model");
+    tinygltf::Model &model = loaded.model;
+    RenderScene scene;
+    // the whole hierarchy of the default scene, or of the first one when none is marked default
+    scene.graph.build(model, model.defaultScene >= 0 ? model.defaultScene : 0);
+    const SceneGraph &graph = scene.graph;
+
+    GeometryPacker geometry(scene, loaded);
+    TextureCache textures(loaded);
+    for (size_t e = 0; e < graph.size(); ++e) {
+        const tinygltf::Mesh *mesh = nodeMesh(model, graph.nodes[e]);
+        if (!mesh) continue;
+        for (const tinygltf::Primitive &primitive : mesh->primitives) {
+            geometry.reserve(primitive);
+        }
+    }
+    // draws follow the graph order, so the draws of an entry are contiguous
+    scene.entryDraws.resize(graph.size() + 1);
+    for (size_t e = 0; e < graph.size(); ++e) {
+        scene.entryDraws[e] = (uint32_t) scene.draws.size();
+        const tinygltf::Mesh *mesh = nodeMesh(model, graph.nodes[e]);
+        if (!mesh) continue;
+        for (size_t i = 0; i < mesh->primitives.size(); ++i) {
+            bindMesh(scene, loaded, geometry, textures, *mesh, i, graph.world[e]);
+        }
+    }
+    scene.entryDraws[graph.size()] = (uint32_t) scene.draws.size();
+    geometry.finish();
+    bindLights(scene, model);
+    geometry.printStats();
+    textures.printStats();
+
+    return scene;
+}
+
+void updateTransforms(RenderScene &scene, ThreadPool *pool) {
+    if (!scene.graph.dirty()) return;
+    for (uint32_t entry : scene.graph.update(pool)) {
+        const glm::mat4 &world = scene.graph.world[entry];
+        for (uint32_t d = scene.entryDraws[entry]; d < scene.entryDraws[entry + 1]; ++d) {
+            scene.draws[d].setModel(world);
+        }
+    }
+}
+
+void createVertexArrays(RenderScene &scene) {
+    // one VAO per layout and pair of vertex and index buffers, shared by all their draws
+    std::map<std::tuple<int, GLuint, GLuint>, GLuint> shared;
+    for (DrawItem &item : scene.draws) {
+        auto key = std::make_tuple(item.layout, item.vertexBuffer, item.indexBuffer);
+        auto found = shared.find(key);
+        if (found != shared.end()) {
+            item.vao = found->second;
+            continue;
+        }
+
+        glGenVertexArrays(1, &item.vao);
+        glBindVertexArray(item.vao);
+        scene.vaos.push_back(item.vao);
+        shared[key] = item.vao;
+
+        const VertexLayout &layout = scene.layouts[item.layout];
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, item.indexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, item.vertexBuffer);
+        for (const VertexAttrib &va : layout.attribs) {
+            glVertexAttribPointer(va.location, va.size, va.type, va.normalized,
+                                  layout.stride, BUFFER_OFFSET(va.offset));
+            glEnableVertexAttribArray(va.location);
+        }
+    }
+    glBindVertexArray(0);
+}
@@ -0,0 +1,585 @@
+#include "include/scene_cache.h"
+#include "include/load_report.h"
+#include "include/texture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'g', 'l', 'T', 'F', 'c', 'a', 'c', 'h'};
+// 9: textures store the levels they have, not always the full chain
+// 10: the texture options follow the source hash
+const uint32_t CACHE_VERSION = 10;
+
+// appends little-endian fields to the cache file
+struct CacheWriter {
+    std::ofstream out;
+
+    template<typename T>
+    void pod(const T &value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+    void bytes(const void *data, uint64_t size) {
+        pod(size);
+        out.write(static_cast<const char *>(data), (std::streamsize) size);
+        // keep every blob 4-byte aligned in the mapping
+        static const char padding[4] = {0, 0, 0, 0};
+        out.write(padding, (std::streamsize) ((4 - size % 4) % 4));
+    }
+    void string(const std::string &s) {
+        bytes(s.data(), s.size());
+    }
+};
+
+// reads fields back from the mapped cache, `ok` turns false on truncated data
+struct CacheReader {
+    const unsigned char *cur;
+    const unsigned char *end;
+    bool ok;
+
+    CacheReader(const unsigned char *begin, const unsigned char *end) : cur(begin), end(end), ok(true) {}
+
+    template<typename T>
+    T pod() {
+        T value;
+        std::memset(&value, 0, sizeof(T));
+        if ((size_t) (end - cur) < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, cur, sizeof(T));
+        cur += sizeof(T);
+        return value;
+    }
+    const unsigned char *bytes(uint64_t &size) {
+        size = pod<uint64_t>();
+        uint64_t padded = size + (4 - size % 4) % 4;
+        if (!ok || (uint64_t) (end - cur) < padded) {
+            ok = false;
+            size = 0;
+            return nullptr;
+        }
+        const unsigned char *data = cur;
+        cur += padded;
+        return data;
+    }
+    std::string string() {
+        uint64_t size;
+        const unsigned char *data = bytes(size);
+        return data ? std::string(reinterpret_cast<const char *>(data), size) : std::string();
+    }
+};
+
+// size and modification time identify an unchanged external file
+bool fileStamp(const std::string &path, uint64_t &size, int64_t &mtime) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = (uint64_t) st.st_size;
+    mtime = (int64_t) st.st_mtime;
+    return true;
+}
+
+std::string baseDirectory(const std::string &filename) {
+    size_t slash = filename.find_last_of("/\\");
+    return slash == std::string::npos ? "" : filename.substr(0, slash + 1);
+}
+
+// external files referenced by buffers and images of the model, uris decoded like tinygltf opens them
+std::vector<std::string> dependencies(const LoadedModel &loaded, const std::string &source) {
+    std::vector<std::string> paths;
+    std::string base = baseDirectory(source);
+    for (const auto &buffer : loaded.model.buffers) {
+        if (!buffer.uri.empty() && !tinygltf::IsDataURI(buffer.uri)) {
+            paths.push_back(base + tinygltf::DecodeURI(buffer.uri));
+        }
+    }
+    for (const auto &image : loaded.model.images) {
+        if (!image.uri.empty() && !tinygltf::IsDataURI(image.uri)) {
+            paths.push_back(base + tinygltf::DecodeURI(image.uri));
+        }
+    }
+    return paths;
+}
+
+// pixel transfer format matching the storage GL picked for a texture
+void readbackFormat(GLint &channels, GLenum &format, GLenum &type) {
+    GLint red, green, blue, alpha;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_RED_SIZE, &red);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_GREEN_SIZE, &green);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_BLUE_SIZE, &blue);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_ALPHA_SIZE, &alpha);
+
+    if (alpha > 0) {
+        channels = 4;
+        format = GL_RGBA;
+    } else if (blue > 0) {
+        channels = 3;
+        format = GL_RGB;
+    } else if (green > 0) {
+        channels = 2;
+        format = GL_RG;
+    } else {
+        channels = 1;
+        format = GL_RED;
+    }
+    type = red > 8 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+}
+
+}
+
+
+void makeDirectory(const std::string &dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+}
+
+SceneCache::SceneCache(const std::string &directory, const std::string &source, const LoadOptions &options)
+    : directory(directory), source(source),
+      textureOptions((options.compressTextures ? 1u : 0u) | (options.compressTextures && options.compressBc7 ? 2u : 0u))
+{
+}
+
+uint64_t SceneCache::hashBytes(const unsigned char *data, size_t size, uint64_t seed)
+{
+    // FNV-1a over 64-bit words, the tail byte by byte
+    const uint64_t prime = 1099511628211ull;
+    uint64_t hash = seed;
+    size_t words = size / 8;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        std::memcpy(&word, data + i * 8, 8);
+        hash = (hash ^ word) * prime;
+    }
+    for (size_t i = words * 8; i < size; ++i) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+bool SceneCache::hashSource()
+{
+    MappedFile sourceFile;
+    if (!sourceFile.open(source)) return false;
+    sourceFile.adviseSequential();
+    sourceHash = hashBytes(sourceFile.data(), sourceFile.size());
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.scene", (unsigned long long) sourceHash);
+    path = directory + "/" + name;
+    return true;
+}
+
+bool SceneCache::open()
+{
+    if (!hashSource() || !file.open(path)) return false;
+    loadreport::addRead(path, file.size());
+
+    CacheReader reader(file.data(), file.data() + file.size());
+    char magic[8];
+    for (char &c : magic) c = reader.pod<char>();
+    uint32_t version = reader.pod<uint32_t>();
+    uint64_t hash = reader.pod<uint64_t>();
+    if (!reader.ok || std::memcmp(magic, CACHE_MAGIC, 8) != 0 || version != CACHE_VERSION || hash != sourceHash) {
+        file.close();
+        return false;
+    }
+    uint32_t writtenOptions = reader.pod<uint32_t>();
+    if (!reader.ok || writtenOptions != textureOptions) {
+        std::cout << "Scene cache is stale: written with other texture compression options" << std::endl;
+        file.close();
+        return false;
+    }
+
+    uint32_t dependencyCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < dependencyCount && reader.ok; ++i) {
+        std::string dependency = reader.string();
+        uint64_t size = reader.pod<uint64_t>();
+        int64_t mtime = reader.pod<int64_t>();
+        uint64_t currentSize;
+        int64_t currentMtime;
+        if (!fileStamp(dependency, currentSize, currentMtime) || currentSize != size || currentMtime != mtime) {
+            std::cout << "Scene cache is stale: " << dependency << " changed" << std::endl;
+            file.close();
+            return false;
+        }
+    }
+    if (!reader.ok) {
+        file.close();
+        return false;
+    }
+
+    bodyOffset = reader.cur - file.data();
+    return true;
+}
+
+bool SceneCache::upload(RenderScene &scene)
+{
+    loadreport::Stage stage("upload scene cache");
+    if (!file.isOpen()) return false;
+    CacheReader reader(file.data() + bodyOffset, file.data() + file.size());
+
+    uint32_t lightCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < lightCount && reader.ok; ++i) {
+        PointLight light;
+        light.position = reader.pod<glm::vec3>();
+        light.color = reader.pod<glm::vec3>();
+        scene.lights.push_back(light);
+    }
+
+    uint32_t bufferCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < bufferCount && reader.ok; ++i) {
+        uint64_t size;
+        const unsigned char *data = reader.bytes(size);
+        if (!data) break;
+
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) size, data, GL_STATIC_DRAW);
+        scene.buffers.push_back(buffer);
+        scene.bufferSizes.push_back(size);
+        loadreport::addUploaded("cached buffer", std::to_string(i), size, 0.0);
+    }
+
+    uint32_t layoutCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < layoutCount && reader.ok; ++i) {
+        VertexLayout layout;
+        layout.stride = reader.pod<int32_t>();
+        uint32_t attribCount = reader.pod<uint32_t>();
+        for (uint32_t a = 0; a < attribCount && reader.ok; ++a) {
+            VertexAttrib va;
+            va.location = reader.pod<uint32_t>();
+            va.size = reader.pod<int32_t>();
+            va.type = reader.pod<uint32_t>();
+            va.normalized = (GLboolean) reader.pod<uint32_t>();
+            va.offset = reader.pod<uint32_t>();
+            layout.attribs.push_back(va);
+        }
+        scene.layouts.push_back(layout);
+    }
+
+    uint32_t samplerCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < samplerCount && reader.ok; ++i) {
+        GLuint sampler;
+        glGenSamplers(1, &sampler);
+        scene.samplers.push_back(sampler);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, reader.pod<int32_t>());
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, reader.pod<int32_t>());
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, reader.pod<int32_t>());
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, reader.pod<int32_t>());
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    uint32_t textureCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < textureCount && reader.ok; ++i) {
+        GLuint texid;
+        glGenTextures(1, &texid);
+        scene.textures.push_back(texid);
+        glBindTexture(GL_TEXTURE_2D, texid);
+
+        GLint internalFormat = reader.pod<int32_t>();
+        GLenum format = reader.pod<uint32_t>();
+        GLenum type = reader.pod<uint32_t>();
+        uint32_t levels = reader.pod<uint32_t>();
+
+        // compressed levels are collected and uploaded together
+        std::vector<CompressedLevel> blocks;
+        int32_t width = 0, height = 0;
+        for (uint32_t level = 0; level < levels && reader.ok; ++level) {
+            int32_t w = reader.pod<int32_t>();
+            int32_t h = reader.pod<int32_t>();
+            uint64_t size;
+            const unsigned char *data = reader.bytes(size);
+            if (!data) break;
+            loadreport::addUploaded("cached texture", std::to_string(i), size, 0.0);
+            if (level == 0) {
+                width = w;
+                height = h;
+            }
+            if (format == 0) {
+                CompressedLevel block = {data, (size_t) size};
+                blocks.push_back(block);
+                continue;
+            }
+            if (level == 0) {
+                textureStorage((GLenum) internalFormat, format, type, w, h);
+            }
+            glTexSubImage2D(GL_TEXTURE_2D, (GLint) level, 0, 0, w, h, format, type, data);
+        }
+        if (!blocks.empty() && blocks.size() == levels) {
+            compressedStorage((GLenum) internalFormat, width, height, blocks);
+        }
+    }
+
+    uint32_t drawCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < drawCount && reader.ok; ++i) {
+        DrawItem item;
+        item.mode = reader.pod<uint32_t>();
+        item.count = reader.pod<int32_t>();
+        item.indexType = reader.pod<uint32_t>();
+        item.indexOffset = reader.pod<uint64_t>();
+        item.baseVertex = reader.pod<int32_t>();
+        item.layout = reader.pod<int32_t>();
+        int32_t indexBuffer = reader.pod<int32_t>();
+        int32_t vertexBuffer = reader.pod<int32_t>();
+        int32_t texture = reader.pod<int32_t>();
+        int32_t sampler = reader.pod<int32_t>();
+        item.material.basecolor = reader.pod<glm::vec3>();
+        item.material.uvTransform = reader.pod<glm::mat3>();
+        glm::mat4 model = reader.pod<glm::mat4>();
+        item.localCenter = reader.pod<glm::vec3>();
+        item.localRadius = reader.pod<float>();
+        item.setModel(model);
+        int buffers = (int) scene.buffers.size();
+        if (!reader.ok || indexBuffer < 0 || indexBuffer >= buffers || vertexBuffer < 0 || vertexBuffer >= buffers
+            || item.layout < 0 || item.layout >= (int) scene.layouts.size()
+            || texture >= (int) scene.textures.size() || sampler >= (int) scene.samplers.size()) {
+            reader.ok = false;
+            break;
+        }
+        item.material.baseColorId = texture >= 0 ? scene.textures[texture] : 0;
+        item.material.baseColorSampler = sampler >= 0 ? scene.samplers[sampler] : 0;
+
+        item.vao = 0;
+        item.indexBuffer = scene.buffers[indexBuffer];
+        item.vertexBuffer = scene.buffers[vertexBuffer];
+        scene.draws.push_back(std::move(item));
+    }
+
+    // the node hierarchy, so a cached scene moves like a loaded one
+    uint32_t entryCount = reader.pod<uint32_t>();
+    for (uint32_t i = 0; i < entryCount && reader.ok; ++i) {
+        scene.graph.nodes.push_back(reader.pod<int32_t>());
+        scene.graph.parents.push_back(reader.pod<int32_t>());
+        scene.graph.local.push_back(reader.pod<glm::mat4>());
+    }
+    for (uint32_t i = 0; i <= entryCount && reader.ok; ++i) {
+        uint32_t first = reader.pod<uint32_t>();
+        if (first > scene.draws.size() || (i > 0 && first < scene.entryDraws.back())) {
+            reader.ok = false;
+            break;
+        }
+        scene.entryDraws.push_back(first);
+    }
+    if (reader.ok && !scene.graph.rebuild()) {
+        reader.ok = false;
+    }
+
+    // the GL copies are all that is needed from here on
+    file.close();
+
+    if (!reader.ok) {
+        std::cout << "Scene cache is corrupt: " << path << std::endl;
+        scene.release();
+        return false;
+    }
+    return true;
+}
+
+bool SceneCache::write(const RenderScene &scene, const LoadedModel &loaded)
+{
+    if (path.empty() && !hashSource()) return false;
+
+    // a dependency that cannot be stamped could never invalidate the cache, so nothing is cached
+    std::vector<std::string> deps = dependencies(loaded, source);
+    std::vector<std::pair<uint64_t, int64_t>> stamps;
+    for (const std::string &dep : deps) {
+        uint64_t size;
+        int64_t mtime;
+        if (!fileStamp(dep, size, mtime)) {
+            std::cout << "Scene cache not written: " << dep << " is missing" << std::endl;
+            return false;
+        }
+        stamps.push_back(std::make_pair(size, mtime));
+    }
+
+    makeDirectory(directory);
+    std::string tmpPath = path + ".tmp";
+    CacheWriter writer;
+    writer.out.open(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!writer.out) {
+        std::cout << "Cannot write scene cache: " << tmpPath << std::endl;
+        return false;
+    }
+
+    writer.out.write(CACHE_MAGIC, 8);
+    writer.pod(CACHE_VERSION);
+    writer.pod(sourceHash);
+    writer.pod(textureOptions);
+
+    writer.pod((uint32_t) deps.size());
+    for (size_t i = 0; i < deps.size(); ++i) {
+        writer.string(deps[i]);
+        writer.pod(stamps[i].first);
+        writer.pod(stamps[i].second);
+    }
+
+    writer.pod((uint32_t) scene.lights.size());
+    for (const PointLight &light : scene.lights) {
+        writer.pod(light.position);
+        writer.pod(light.color);
+    }
+
+    // the arena buffers as far as they are in use, read back from GL
+    writer.pod((uint32_t) scene.buffers.size());
+    std::vector<unsigned char> bytes;
+    for (size_t i = 0; i < scene.buffers.size(); ++i) {
+        bytes.resize(scene.bufferSizes[i]);
+        glBindBuffer(GL_ARRAY_BUFFER, scene.buffers[i]);
+        glGetBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) bytes.size(), bytes.data());
+        writer.bytes(bytes.data(), bytes.size());
+    }
+    auto bufferIndex = [&](GLuint buffer) {
+        return (int32_t) (std::find(scene.buffers.begin(), scene.buffers.end(), buffer) - scene.buffers.begin());
+    };
+
+    writer.pod((uint32_t) scene.layouts.size());
+    for (const VertexLayout &layout : scene.layouts) {
+        writer.pod((int32_t) layout.stride);
+        writer.pod((uint32_t) layout.attribs.size());
+        for (const VertexAttrib &va : layout.attribs) {
+            writer.pod((uint32_t) va.location);
+            writer.pod((int32_t) va.size);
+            writer.pod((uint32_t) va.type);
+            writer.pod((uint32_t) va.normalized);
+            writer.pod((uint32_t) va.offset);
+        }
+    }
+
+    // sampler objects the draws use, their state read back from GL
+    std::vector<GLuint> samplers;
+    for (const DrawItem &item : scene.draws) {
+        GLuint id = item.material.baseColorSampler;
+        if (id > 0 && std::find(samplers.begin(), samplers.end(), id) == samplers.end()) samplers.push_back(id);
+    }
+    writer.pod((uint32_t) samplers.size());
+    for (GLuint id : samplers) {
+        GLint minFilter, magFilter, wrapS, wrapT;
+        glGetSamplerParameteriv(id, GL_TEXTURE_MIN_FILTER, &minFilter);
+        glGetSamplerParameteriv(id, GL_TEXTURE_MAG_FILTER, &magFilter);
+        glGetSamplerParameteriv(id, GL_TEXTURE_WRAP_S, &wrapS);
+        glGetSamplerParameteriv(id, GL_TEXTURE_WRAP_T, &wrapT);
+        writer.pod((int32_t) minFilter);
+        writer.pod((int32_t) magFilter);
+        writer.pod((int32_t) wrapS);
+        writer.pod((int32_t) wrapT);
+    }
+
+    // every mip level glGenerateMipmap built, read back from GL
+    std::vector<GLuint> textures;
+    for (const DrawItem &item : scene.draws) {
+        GLuint id = item.material.baseColorId;
+        if (id > 0 && std::find(textures.begin(), textures.end(), id) == textures.end()) textures.push_back(id);
+    }
+    writer.pod((uint32_t) textures.size());
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    std::vector<unsigned char> pixels;
+    for (GLuint id : textures) {
+        glBindTexture(GL_TEXTURE_2D, id);
+        GLint internalFormat, w, h;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+
+        GLint channels, compressed;
+        GLenum format, type;
+        readbackFormat(channels, format, type);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        // KTX2 chains may be shorter than the full one, only the levels the texture has are read
+        uint32_t levels = (uint32_t) textureLevels();
+
+        // format 0 marks blocks stored as they are
+        writer.pod((int32_t) internalFormat);
+        writer.pod((uint32_t) (compressed ? 0 : format));
+        writer.pod((uint32_t) (compressed ? 0 : type));
+        writer.pod(levels);
+        for (uint32_t level = 0; level < levels; ++level) {
+            GLint lw, lh;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint) level, GL_TEXTURE_WIDTH, &lw);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint) level, GL_TEXTURE_HEIGHT, &lh);
+            if (compressed) {
+                GLint size;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, (GLint) level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                pixels.resize((size_t) size);
+                glGetCompressedTexImage(GL_TEXTURE_2D, (GLint) level, pixels.data());
+            } else {
+                pixels.resize((size_t) lw * lh * channels * (type == GL_UNSIGNED_SHORT ? 2 : 1));
+                glGetTexImage(GL_TEXTURE_2D, (GLint) level, format, type, pixels.data());
+            }
+            writer.pod((int32_t) lw);
+            writer.pod((int32_t) lh);
+            writer.bytes(pixels.data(), pixels.size());
+        }
+    }
+
+    writer.pod((uint32_t) scene.draws.size());
+    for (const DrawItem &item : scene.draws) {
+        int32_t texture = -1;
+        if (item.material.baseColorId > 0) {
+            texture = (int32_t) (std::find(textures.begin(), textures.end(), item.material.baseColorId) - textures.begin());
+        }
+        int32_t sampler = -1;
+        if (item.material.baseColorSampler > 0) {
+            sampler = (int32_t) (std::find(samplers.begin(), samplers.end(), item.material.baseColorSampler) - samplers.begin());
+        }
+        writer.pod((uint32_t) item.mode);
+        writer.pod((int32_t) item.count);
+        writer.pod((uint32_t) item.indexType);
+        writer.pod((uint64_t) item.indexOffset);
+        writer.pod((int32_t) item.baseVertex);
+        writer.pod((int32_t) item.layout);
+        writer.pod(bufferIndex(item.indexBuffer));
+        writer.pod(bufferIndex(item.vertexBuffer));
+        writer.pod(texture);
+        writer.pod(sampler);
+        writer.pod(item.material.basecolor);
+        writer.pod(item.material.uvTransform);
+        writer.pod(item.model);
+        writer.pod(item.localCenter);
+        writer.pod(item.localRadius);
+    }
+
+    const SceneGraph &graph = scene.graph;
+    writer.pod((uint32_t) graph.size());
+    for (size_t e = 0; e < graph.size(); ++e) {
+        writer.pod((int32_t) graph.nodes[e]);
+        writer.pod((int32_t) graph.parents[e]);
+        writer.pod(graph.local[e]);
+    }
+    for (uint32_t first : scene.entryDraws) {
+        writer.pod(first);
+    }
+    if (scene.entryDraws.empty()) {
+        writer.pod((uint32_t) scene.draws.size());
+    }
+
+    writer.out.close();
+    if (!writer.out) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    // replace atomically so a concurrent viewer never maps a half written cache
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::cout << "Wrote scene cache: " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,518 @@
+#include "include/scene_graph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <numeric>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SCENE_GRAPH_X86 1
+#include <immintrin.h>
+#endif
+
+
+glm::mat4 createTranslationMatrix(const std::vector<double> &trans) {
+    glm::mat4 transMat;
+    if (trans.size() > 0) {
+        transMat =  glm::translate(glm::mat4(1.0f),  glm::vec3(trans[0], trans[1], trans[2]));
+    } else {
+        transMat =  glm::mat4(1.0f);
+    }
+    return transMat;
+
+}
+
+glm::mat4 createRotationMatrix(const std::vector<double> &rot) {
+    glm::mat4 rotMat;
+    if (rot.size() > 0) {
+        glm::quat quat = glm::quat(rot[3], rot[0], rot[1], rot[2]);
+        rotMat =  glm::mat4_cast(quat);
+    } else {
+        glm::quat quat = glm::quat(1, 0, 0, 0);
+        rotMat =  glm::mat4_cast(quat);
+//        rotMat = glm::mat4(1.0f);
+    }
+    return rotMat;
+
+}
+
+glm::mat4 createScaleMatrix(const std::vector<double> &scale) {
+    glm::mat4 scaleMat;
+    if (scale.size() > 0) {
+        scaleMat = glm::scale(glm::mat4(1.0f),  glm::vec3(scale[0], scale[1], scale[2]));
+    } else {
+        scaleMat = glm::mat4(1.0f);
+    }
+    return scaleMat;
+}
+
+glm::mat4 createModelMatrix(const tinygltf::Node &node) {
+    // glTF matrices are column major like glm
+    if (node.matrix.size() == 16) {
+        return glm::mat4(glm::make_mat4(node.matrix.data()));
+    }
+    glm::mat4 translationMatrix = createTranslationMatrix(node.translation);
+    glm::mat4  rotationMatrix = createRotationMatrix(node.rotation);
+    glm::mat4 scaleMatrix = createScaleMatrix(node.scale);
+    glm::mat4 model = translationMatrix * rotationMatrix * scaleMatrix;
+    return model;
+}
+
+
+namespace {
+
+// update() recomputes every level once this share of the entries changed
+const size_t FULL_UPDATE_DIVISOR = 8;
+// levels smaller than this are not worth splitting over the pool
+const size_t PARALLEL_LEVEL = 8192;
+
+// kernels by speed, updateAll takes the fastest the CPU runs
+enum Kernel {
+    KERNEL_SCALAR,
+    KERNEL_AVX2,
+};
+
+// translation * rotation * scale of `entry`, the same matrix createModelMatrix builds
+void composeLocal(const SceneGraph::TRS &trs, size_t entry, glm::mat4 &out) {
+    float x = trs.rx[entry], y = trs.ry[entry], z = trs.rz[entry], w = trs.rw[entry];
+    float sx = trs.sx[entry], sy = trs.sy[entry], sz = trs.sz[entry];
+    out[0] = glm::vec4((1.0f - 2.0f * (y * y + z * z)) * sx, 2.0f * (x * y + w * z) * sx,
+                       2.0f * (x * z - w * y) * sx, 0.0f);
+    out[1] = glm::vec4(2.0f * (x * y - w * z) * sy, (1.0f - 2.0f * (x * x + z * z)) * sy,
+                       2.0f * (y * z + w * x) * sy, 0.0f);
+    out[2] = glm::vec4(2.0f * (x * z + w * y) * sz, 2.0f * (y * z - w * x) * sz,
+                       (1.0f - 2.0f * (x * x + y * y)) * sz, 0.0f);
+    out[3] = glm::vec4(trs.tx[entry], trs.ty[entry], trs.tz[entry], 1.0f);
+}
+
+// composes and multiplies the entries begin .. end of one level, their parents are done
+void updateRangeScalar(SceneGraph &graph, size_t begin, size_t end) {
+    for (size_t e = begin; e < end; ++e) {
+        if (!graph.fixedMatrix[e]) composeLocal(graph.trs, e, graph.local[e]);
+        int parent = graph.parents[e];
+        graph.world[e] = parent < 0 ? graph.local[e] : graph.world[parent] * graph.local[e];
+    }
+}
+
+#ifdef SCENE_GRAPH_X86
+
+// out[l] = (a[l], b[l], c[l], d[l]) for the eight lanes
+__attribute__((target("avx2"))) inline void transpose(__m256 a, __m256 b, __m256 c, __m256 d, __m128 out[8]) {
+    __m256 ab0 = _mm256_unpacklo_ps(a, b);
+    __m256 ab1 = _mm256_unpackhi_ps(a, b);
+    __m256 cd0 = _mm256_unpacklo_ps(c, d);
+    __m256 cd1 = _mm256_unpackhi_ps(c, d);
+    __m256 l0 = _mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 l1 = _mm256_shuffle_ps(ab0, cd0, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 l2 = _mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 l3 = _mm256_shuffle_ps(ab1, cd1, _MM_SHUFFLE(3, 2, 3, 2));
+    out[0] = _mm256_castps256_ps128(l0);
+    out[1] = _mm256_castps256_ps128(l1);
+    out[2] = _mm256_castps256_ps128(l2);
+    out[3] = _mm256_castps256_ps128(l3);
+    out[4] = _mm256_extractf128_ps(l0, 1);
+    out[5] = _mm256_extractf128_ps(l1, 1);
+    out[6] = _mm256_extractf128_ps(l2, 1);
+    out[7] = _mm256_extractf128_ps(l3, 1);
+}
+
+// world = parent * local, two columns per register: local[0] holds columns 0
+// and 1, local[1] columns 2 and 3
+__attribute__((target("avx2,fma"))) inline void multiplyAvx2(const float *parent, const __m256 local[2],
+                                                            float *world) {
+    __m256 p0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent));
+    __m256 p1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 4));
+    __m256 p2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 8));
+    __m256 p3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 12));
+    for (int half = 0; half < 2; ++half) {
+        __m256 l = local[half];
+        __m256 columns = _mm256_mul_ps(p0, _mm256_permute_ps(l, _MM_SHUFFLE(0, 0, 0, 0)));
+        columns = _mm256_fmadd_ps(p1, _mm256_permute_ps(l, _MM_SHUFFLE(1, 1, 1, 1)), columns);
+        columns = _mm256_fmadd_ps(p2, _mm256_permute_ps(l, _MM_SHUFFLE(2, 2, 2, 2)), columns);
+        columns = _mm256_fmadd_ps(p3, _mm256_permute_ps(l, _MM_SHUFFLE(3, 3, 3, 3)), columns);
+        _mm256_storeu_ps(world + half * 8, columns);
+    }
+}
+
+// roots are multiplied with this instead of a parent, which keeps their matrix as is
+const float IDENTITY[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                            0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+// updateRangeScalar for eight entries at a time: the TRS arrays are composed
+// lane-wise and transposed into matrix columns. Entries with a fixed matrix
+// keep theirs through a blend, so every lane takes the same path and every
+// matrix is written with 256-bit stores.
+__attribute__((target("avx2,fma"))) void updateRangeAvx2(SceneGraph &graph, size_t begin, size_t end) {
+    const SceneGraph::TRS &trs = graph.trs;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t e = begin;
+    for (; e + 8 <= end; e += 8) {
+        __m256 x = _mm256_loadu_ps(&trs.rx[e]);
+        __m256 y = _mm256_loadu_ps(&trs.ry[e]);
+        __m256 z = _mm256_loadu_ps(&trs.rz[e]);
+        __m256 w = _mm256_loadu_ps(&trs.rw[e]);
+        __m256 sx = _mm256_loadu_ps(&trs.sx[e]);
+        __m256 sy = _mm256_loadu_ps(&trs.sy[e]);
+        __m256 sz = _mm256_loadu_ps(&trs.sz[e]);
+
+        __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+        __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+        __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+        // rotation columns scaled by the scale of their axis, row by row
+        __m256 m00 = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one), sx);
+        __m256 m01 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+        __m256 m02 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+        __m256 m10 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+        __m256 m11 = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one), sy);
+        __m256 m12 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+        __m256 m20 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+        __m256 m21 = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+        __m256 m22 = _mm256_mul_ps(_mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one), sz);
+
+        __m128 columns[4][8];
+        transpose(m00, m01, m02, zero, columns[0]);
+        transpose(m10, m11, m12, zero, columns[1]);
+        transpose(m20, m21, m22, zero, columns[2]);
+        transpose(_mm256_loadu_ps(&trs.tx[e]), _mm256_loadu_ps(&trs.ty[e]), _mm256_loadu_ps(&trs.tz[e]), one,
+                  columns[3]);
+
+        for (size_t lane = 0; lane < 8; ++lane) {
+            size_t entry = e + lane;
+            float *local = &graph.local[entry][0][0];
+            // all ones where the entry keeps its matrix
+            __m256 fixed = _mm256_castsi256_ps(_mm256_set1_epi32(-(int) graph.fixedMatrix[entry]));
+            __m256 matrix[2] = {
+                _mm256_blendv_ps(_mm256_set_m128(columns[1][lane], columns[0][lane]), _mm256_loadu_ps(local), fixed),
+                _mm256_blendv_ps(_mm256_set_m128(columns[3][lane], columns[2][lane]), _mm256_loadu_ps(local + 8),
+                                 fixed),
+            };
+            _mm256_storeu_ps(local, matrix[0]);
+            _mm256_storeu_ps(local + 8, matrix[1]);
+
+            int parent = graph.parents[entry];
+            const float *parentWorld = parent < 0 ? IDENTITY : &graph.world[parent][0][0];
+            multiplyAvx2(parentWorld, matrix, &graph.world[entry][0][0]);
+        }
+    }
+    updateRangeScalar(graph, e, end);
+}
+
+Kernel fastestKernel() {
+    static const Kernel kernel = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? KERNEL_AVX2
+                                                                                                  : KERNEL_SCALAR;
+    return kernel;
+}
+
+#else
+
+Kernel fastestKernel() {
+    return KERNEL_SCALAR;
+}
+
+#endif
+
+void updateRange(SceneGraph &graph, size_t begin, size_t end, Kernel kernel) {
+#ifdef SCENE_GRAPH_X86
+    if (kernel == KERNEL_AVX2) {
+        updateRangeAvx2(graph, begin, end);
+        return;
+    }
+#endif
+    updateRangeScalar(graph, begin, end);
+}
+
+// every level after the one before it, the entries of a level are independent
+void updateLevels(SceneGraph &graph, ThreadPool *pool, Kernel kernel) {
+    for (size_t level = 0; level + 1 < graph.levels.size(); ++level) {
+        size_t begin = graph.levels[level], end = graph.levels[level + 1];
+        size_t count = end - begin;
+        if (!pool || pool->size() < 2 || count < PARALLEL_LEVEL) {
+            updateRange(graph, begin, end, kernel);
+            continue;
+        }
+        // a few chunks per worker evens out the load, each a multiple of the 8 lanes
+        size_t chunks = (size_t) pool->size() * 4;
+        size_t chunk = ((count + chunks - 1) / chunks + 7) & ~(size_t) 7;
+        pool->parallelFor((count + chunk - 1) / chunk, [&](size_t i) {
+            size_t from = begin + i * chunk;
+            updateRange(graph, from, std::min(end, from + chunk), kernel);
+        });
+    }
+}
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+
+void SceneGraph::build(const tinygltf::Model &model, int scene) {
+    nodes.clear();
+    parents.clear();
+    local.clear();
+    trs = TRS();
+    fixedMatrix.clear();
+    std::vector<char> visited(model.nodes.size(), 0);
+    auto add = [&](int node, int parent) {
+        if (node < 0 || node >= (int) model.nodes.size() || visited[node]) return;
+        visited[node] = 1;
+        const tinygltf::Node &gltfNode = model.nodes[node];
+        nodes.push_back(node);
+        parents.push_back(parent);
+        local.push_back(createModelMatrix(gltfNode));
+
+        const std::vector<double> &t = gltfNode.translation, &r = gltfNode.rotation, &sc = gltfNode.scale;
+        fixedMatrix.push_back(gltfNode.matrix.size() == 16);
+        trs.tx.push_back(t.size() == 3 ? (float) t[0] : 0.0f);
+        trs.ty.push_back(t.size() == 3 ? (float) t[1] : 0.0f);
+        trs.tz.push_back(t.size() == 3 ? (float) t[2] : 0.0f);
+        trs.rx.push_back(r.size() == 4 ? (float) r[0] : 0.0f);
+        trs.ry.push_back(r.size() == 4 ? (float) r[1] : 0.0f);
+        trs.rz.push_back(r.size() == 4 ? (float) r[2] : 0.0f);
+        trs.rw.push_back(r.size() == 4 ? (float) r[3] : 1.0f);
+        trs.sx.push_back(sc.size() == 3 ? (float) sc[0] : 1.0f);
+        trs.sy.push_back(sc.size() == 3 ? (float) sc[1] : 1.0f);
+        trs.sz.push_back(sc.size() == 3 ? (float) sc[2] : 1.0f);
+    };
+
+    if (scene >= 0 && scene < (int) model.scenes.size()) {
+        for (int node : model.scenes[scene].nodes) add(node, -1);
+    } else {
+        std::vector<char> isChild(model.nodes.size(), 0);
+        for (const tinygltf::Node &node : model.nodes) {
+            for (int child : node.children) {
+                if (child >= 0 && child < (int) model.nodes.size()) isChild[child] = 1;
+            }
+        }
+        for (size_t node = 0; node < model.nodes.size(); ++node) {
+            if (!isChild[node]) add((int) node, -1);
+        }
+    }
+    // the entries appended while walking are the queue of the breadth-first walk
+    for (size_t e = 0; e < nodes.size(); ++e) {
+        for (int child : model.nodes[nodes[e]].children) add(child, (int) e);
+    }
+    rebuild();
+}
+
+bool SceneGraph::rebuild() {
+    size_t count = nodes.size();
+    if (parents.size() != count || local.size() != count) return false;
+
+    // breadth-first: roots first, then every entry after its parent and ordered by it
+    firstChild.assign(count, 0);
+    childCount.assign(count, 0);
+    int lastParent = -1;
+    for (size_t e = 0; e < count; ++e) {
+        int parent = parents[e];
+        if (parent < 0) {
+            if (lastParent >= 0) return false;
+            continue;
+        }
+        if (parent < lastParent || parent >= (int) e) return false;
+        if (childCount[parent] == 0) firstChild[parent] = (uint32_t) e;
+        childCount[parent]++;
+        lastParent = parent;
+    }
+
+    // in that order the depth never decreases, a level ends where it grows
+    std::vector<uint32_t> depth(count, 0);
+    levels.clear();
+    for (size_t e = 0; e < count; ++e) {
+        if (parents[e] >= 0) depth[e] = depth[parents[e]] + 1;
+        if (e == 0 || depth[e] != depth[e - 1]) levels.push_back((uint32_t) e);
+    }
+    levels.push_back((uint32_t) count);
+
+    // without TRS, as from the scene cache, every local matrix stays as given
+    if (fixedMatrix.size() != count) {
+        fixedMatrix.assign(count, 1);
+        trs.tx.assign(count, 0.0f);
+        trs.ty.assign(count, 0.0f);
+        trs.tz.assign(count, 0.0f);
+        trs.rx.assign(count, 0.0f);
+        trs.ry.assign(count, 0.0f);
+        trs.rz.assign(count, 0.0f);
+        trs.rw.assign(count, 1.0f);
+        trs.sx.assign(count, 1.0f);
+        trs.sy.assign(count, 1.0f);
+        trs.sz.assign(count, 1.0f);
+    }
+
+    world.resize(count);
+    for (size_t e = 0; e < count; ++e) {
+        world[e] = parents[e] < 0 ? local[e] : world[parents[e]] * local[e];
+    }
+    dirtyFlags.assign(count, 0);
+    dirtyEntries.clear();
+    changed.clear();
+    return true;
+}
+
+void SceneGraph::setLocal(uint32_t entry, const glm::mat4 &matrix) {
+    local[entry] = matrix;
+    fixedMatrix[entry] = 1;
+    if (!dirtyFlags[entry]) {
+        dirtyFlags[entry] = 1;
+        dirtyEntries.push_back(entry);
+    }
+}
+
+void SceneGraph::setTRS(uint32_t entry, const glm::vec3 &translation, const glm::quat &rotation,
+                        const glm::vec3 &scale) {
+    trs.tx[entry] = translation.x;
+    trs.ty[entry] = translation.y;
+    trs.tz[entry] = translation.z;
+    trs.rx[entry] = rotation.x;
+    trs.ry[entry] = rotation.y;
+    trs.rz[entry] = rotation.z;
+    trs.rw[entry] = rotation.w;
+    trs.sx[entry] = scale.x;
+    trs.sy[entry] = scale.y;
+    trs.sz[entry] = scale.z;
+    fixedMatrix[entry] = 0;
+    if (!dirtyFlags[entry]) {
+        dirtyFlags[entry] = 1;
+        dirtyEntries.push_back(entry);
+    }
+}
+
+void SceneGraph::updateAll(ThreadPool *pool) {
+    updateLevels(*this, pool, fastestKernel());
+}
+
+const std::vector<uint32_t> &SceneGraph::update(ThreadPool *pool) {
+    changed.clear();
+    if (dirtyEntries.empty()) return changed;
+
+    // with most of an animated scene moving, walking subtrees costs more than redoing every level
+    if (dirtyEntries.size() * FULL_UPDATE_DIVISOR >= size()) {
+        for (uint32_t entry : dirtyEntries) dirtyFlags[entry] = 0;
+        dirtyEntries.clear();
+        updateAll(pool);
+        changed.resize(size());
+        std::iota(changed.begin(), changed.end(), 0u);
+        return changed;
+    }
+
+    for (uint32_t entry : dirtyEntries) {
+        if (!fixedMatrix[entry]) composeLocal(trs, entry, local[entry]);
+    }
+    // entries below another dirty entry are recomputed with its subtree
+    for (uint32_t entry : dirtyEntries) {
+        bool covered = false;
+        for (int parent = parents[entry]; parent >= 0 && !covered; parent = parents[parent]) {
+            covered = dirtyFlags[parent] != 0;
+        }
+        if (!covered) changed.push_back(entry);
+    }
+    for (uint32_t entry : dirtyEntries) dirtyFlags[entry] = 0;
+    dirtyEntries.clear();
+
+    // the subtrees are disjoint, each is walked breadth-first from its root
+    for (size_t i = 0; i < changed.size(); ++i) {
+        uint32_t entry = changed[i];
+        int parent = parents[entry];
+        world[entry] = parent < 0 ? local[entry] : world[parent] * local[entry];
+        for (uint32_t child = firstChild[entry]; child < firstChild[entry] + childCount[entry]; ++child) {
+            changed.push_back(child);
+        }
+    }
+    return changed;
+}
+
+void benchmarkTransforms(size_t nodes, int runs) {
+    if (nodes == 0 || runs <= 0) return;
+
+    // a tree of fanout 4 like a deep assembly, every node offset, turned and scaled a little
+    const size_t FANOUT = 4;
+    tinygltf::Model model;
+    model.nodes.resize(nodes);
+    for (size_t i = 1; i < nodes; ++i) {
+        model.nodes[(i - 1) / FANOUT].children.push_back((int) i);
+    }
+    tinygltf::Scene scene;
+    scene.nodes.push_back(0);
+    model.scenes.push_back(scene);
+
+    SceneGraph graph;
+    graph.build(model, 0);
+    std::cout << "transforms: " << graph.size() << " nodes in " << graph.levels.size() - 1 << " levels" << std::endl;
+
+    // a frame of the animation moves every node
+    auto animate = [&](int frame) {
+        for (uint32_t e = 0; e < graph.size(); ++e) {
+            float phase = 0.001f * e + 0.1f * frame;
+            glm::vec3 axis = glm::normalize(glm::vec3(std::sin(phase), 1.0f, std::cos(phase)));
+            graph.setTRS(e, glm::vec3(1.0f + 0.1f * std::sin(phase), 0.5f, 0.0f),
+                         glm::angleAxis(0.3f * std::cos(phase), axis),
+                         glm::vec3(0.9f + 0.05f * std::sin(phase)));
+        }
+    };
+
+    // the matrices before the SoA layout: three glm products per node, then the parent
+    std::vector<glm::mat4> reference(graph.size());
+    auto referenceUpdate = [&]() {
+        for (size_t e = 0; e < graph.size(); ++e) {
+            const SceneGraph::TRS &trs = graph.trs;
+            glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(trs.tx[e], trs.ty[e], trs.tz[e])) *
+                              glm::mat4_cast(glm::quat(trs.rw[e], trs.rx[e], trs.ry[e], trs.rz[e])) *
+                              glm::scale(glm::mat4(1.0f), glm::vec3(trs.sx[e], trs.sy[e], trs.sz[e]));
+            int parent = graph.parents[e];
+            reference[e] = parent < 0 ? local : reference[parent] * local;
+        }
+    };
+
+    auto matches = [&]() {
+        for (size_t e = 0; e < graph.size(); ++e) {
+            for (int c = 0; c < 4; ++c) {
+                for (int r = 0; r < 4; ++r) {
+                    float expected = reference[e][c][r];
+                    if (std::abs(graph.world[e][c][r] - expected) > 1e-4f * std::max(1.0f, std::abs(expected))) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    };
+
+    auto measure = [&](const std::string &name, const std::function<void()> &run, bool check) {
+        double best = 0.0, total = 0.0;
+        for (int i = 0; i < runs; ++i) {
+            animate(i);
+            auto start = std::chrono::steady_clock::now();
+            run();
+            double ms = msSince(start);
+            if (check) {
+                referenceUpdate();
+                if (!matches()) {
+                    std::cout << name << ": world matrices do not match" << std::endl;
+                    return;
+                }
+            }
+            best = i == 0 ? ms : std::min(best, ms);
+            total += ms;
+        }
+        std::cout << name << ": best " << best << " ms, mean " << total / runs << " ms, "
+                  << graph.size() / (best / 1000.0) / 1e6 << " M nodes/s over " << runs << " runs" << std::endl;
+    };
+
+    measure("glm per node", referenceUpdate, false);
+    static const char *names[] = {"scalar soa", "avx2 soa"};
+    for (int kernel = KERNEL_SCALAR; kernel <= fastestKernel(); ++kernel) {
+        measure(names[kernel], [&]() { updateLevels(graph, nullptr, (Kernel) kernel); }, true);
+    }
+    ThreadPool pool;
+    measure(std::string(names[fastestKernel()]) + " on " + std::to_string(pool.size()) + " threads",
+            [&]() { graph.update(&pool); }, true);
+}
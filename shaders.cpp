@@ -1,4 +1,5 @@
 #include "include/shaders.h"
+#include "include/load_report.h"
 
 
 std::string readFile(const std::string &fileName)
@@ -17,6 +18,7 @@ std::string readFile(const std::string &fileName)
 
 Shaders::Shaders(ShaderType type, const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
+    loadreport::Stage stage("shader compile");
     this->type = type;
 
 	// Create the shaders
@@ -105,6 +107,13 @@ Shaders::Shaders(ShaderType type, const char* vertexPath, const char* fragmentPa
         glDeleteShader(GeometryShaderID);
 
 	this->pid = ProgramID;
+
+    uniforms.mvp = glGetUniformLocation(pid, "mvp");
+    uniforms.model = glGetUniformLocation(pid, "model");
+    uniforms.normalMatrix = glGetUniformLocation(pid, "normal_matrix");
+    uniforms.uvTransform = glGetUniformLocation(pid, "uv_transform");
+    uniforms.basecolor = glGetUniformLocation(pid, "basecolor");
+    uniforms.textured = glGetUniformLocation(pid, "textured");
 }
 
 
@@ -6,6 +6,8 @@ layout(location = 2) in vec2 in_texcoord;
 uniform mat4 mvp;
 uniform mat4 model;
 uniform mat4 normal_matrix;
+// KHR_texture_transform of the base color texture, also undoes texcoord quantization
+uniform mat3 uv_transform;
 
 out vec3 normal;
 out vec3 position;
@@ -20,5 +22,5 @@ void main(){
 //    position = position_homo.xyz/position_homo.w;
 
     position = vec3(model * vec4(in_vertex, 1.0));
-    texcoord = in_texcoord;
+    texcoord = (uv_transform * vec3(in_texcoord, 1.0)).xy;
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "include/staging_ring.h"
+
+#include <iostream>
+
+
+StagingRing::StagingRing(size_t capacity)
+    : ringCapacity(capacity), start(std::chrono::steady_clock::now())
+{
+    if (GLAD_GL_VERSION_4_4 && glBufferStorage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBufferStorage(GL_COPY_READ_BUFFER, (GLsizeiptr) capacity, NULL, flags);
+        mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, (GLsizeiptr) capacity, flags));
+        if (!mapped) {
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+    }
+    if (!mapped) {
+        memory.resize(capacity);
+        mapped = memory.data();
+    }
+}
+
+StagingRing::~StagingRing()
+{
+    for (Segment &segment : inFlight) {
+        glDeleteSync(segment.fence);
+    }
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glDeleteBuffers(1, &buffer);
+    }
+}
+
+bool StagingRing::allocate(size_t size, Region &region)
+{
+    size_t begin = head;
+    if (begin + size > ringCapacity) {
+        // a batch never wraps, so every fenced segment is contiguous
+        if (head != batchBegin || size > ringCapacity) return false;
+        begin = batchBegin = 0;
+    }
+    size_t end = begin + size;
+
+    // the oldest segment is the next one ahead of `begin`, wait until the GPU is done with it
+    while (!inFlight.empty() && inFlight.front().begin < end && begin < inFlight.front().end) {
+        glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(inFlight.front().fence);
+        inFlight.pop_front();
+    }
+
+    head = end;
+    region.data = mapped + begin;
+    region.offset = begin;
+    return true;
+}
+
+void StagingRing::copy(const Region &region, GLuint target, size_t offset, size_t size)
+{
+    if (buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr) region.offset,
+                            (GLintptr) offset, (GLsizeiptr) size);
+    } else {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, target);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr) offset, (GLsizeiptr) size, region.data);
+    }
+    copiedBytes += size;
+}
+
+void StagingRing::fence()
+{
+    if (head == batchBegin) return;
+    // glBufferSubData has consumed the memory by the time it returns
+    if (buffer) {
+        Segment segment;
+        segment.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        segment.begin = batchBegin;
+        segment.end = head;
+        inFlight.push_back(segment);
+    }
+    batchBegin = head;
+}
+
+void StagingRing::finish()
+{
+    fence();
+    while (!inFlight.empty()) {
+        glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(inFlight.front().fence);
+        inFlight.pop_front();
+    }
+    if (copiedBytes == 0) return;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double mb = copiedBytes / (1024.0 * 1024.0);
+    std::cout << "staging: " << mb << " MB in " << ms << " ms (" << mb / (ms / 1000.0) << " MB/s) through "
+              << (buffer ? "a persistently mapped ring" : "glBufferSubData") << std::endl;
+}
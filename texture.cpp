@@ -0,0 +1,268 @@
+#include "include/texture.h"
+#include "include/load_report.h"
+#include "include/loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// EXT_texture_compression_s3tc is not in the generated loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+
+void pixelFormat(const tinygltf::Image &image, GLenum &format, GLenum &type) {
+    format = GL_RGBA;
+
+    if (image.component == 1) {
+        format = GL_RED;
+    } else if (image.component == 2) {
+        format = GL_RG;
+    } else if (image.component == 3) {
+        format = GL_RGB;
+    } else {
+        // ???
+    }
+
+    type = GL_UNSIGNED_BYTE;
+    if (image.bits == 8) {
+        // ok
+    } else if (image.bits == 16) {
+        type = GL_UNSIGNED_SHORT;
+    } else {
+        // ???
+    }
+}
+
+GLenum sizedFormat(const tinygltf::Image &image) {
+    // the shader works on the stored values, so color images are not given sRGB storage
+    static const GLenum formats8[4] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    static const GLenum formats16[4] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+    int channels = std::min(std::max(image.component, 1), 4);
+    return image.bits == 16 ? formats16[channels - 1] : formats8[channels - 1];
+}
+
+int mipLevels(int width, int height) {
+    int levels = 1;
+    while ((width | height) >> levels) levels++;
+    return levels;
+}
+
+int textureLevels() {
+    GLint immutable = 0, levels = 0, maxLevel = 0, w = 0, h = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+    if (GLAD_GL_VERSION_4_2) {
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+    }
+    // GL_TEXTURE_IMMUTABLE_LEVELS is GL 4.3
+    if (immutable && GLAD_GL_VERSION_4_3) {
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+        return levels;
+    }
+    // otherwise every level up to GL_TEXTURE_MAX_LEVEL that has a size, undefined ones report 0
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+    int last = std::min(maxLevel + 1, mipLevels(w, h));
+    while (levels < last) {
+        GLint levelWidth = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, levels, GL_TEXTURE_WIDTH, &levelWidth);
+        if (levelWidth == 0) break;
+        levels++;
+    }
+    return levels;
+}
+
+void textureStorage(GLenum internalFormat, GLenum format, GLenum type, int width, int height) {
+    int levels = mipLevels(width, height);
+    if (GLAD_GL_VERSION_4_2 && glTexStorage2D) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+    } else {
+        // GL 4.1 has no immutable storage, every level is specified the old way
+        for (int level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, (GLint) internalFormat, std::max(width >> level, 1),
+                         std::max(height >> level, 1), 0, format, type, NULL);
+        }
+    }
+    applySwizzle(internalFormat);
+}
+
+void applySwizzle(GLenum internalFormat) {
+    // one channel is grey, two are grey and alpha
+    bool grey = internalFormat == GL_R8 || internalFormat == GL_R16 || internalFormat == GL_COMPRESSED_RED_RGTC1;
+    bool greyAlpha = internalFormat == GL_RG8 || internalFormat == GL_RG16 || internalFormat == GL_COMPRESSED_RG_RGTC2;
+    if (!grey && !greyAlpha) return;
+    GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, greyAlpha ? GL_GREEN : GL_ONE};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+GLenum compressedFormat(BlockFormat format) {
+    switch (format) {
+    case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BLOCK_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BLOCK_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    case BLOCK_BC1A: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    default: return 0;
+    }
+}
+
+bool hasExtension(const char *extension) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char *name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, (GLuint) i));
+        if (name && std::strcmp(name, extension) == 0) return true;
+    }
+    return false;
+}
+
+bool textureCompressionSupported() {
+    return hasExtension("GL_EXT_texture_compression_s3tc");
+}
+
+bool bptcSupported() {
+    return GLAD_GL_VERSION_4_2 || hasExtension("GL_ARB_texture_compression_bptc");
+}
+
+void compressedStorage(GLenum internalFormat, int width, int height, const std::vector<CompressedLevel> &levels) {
+    bool immutable = GLAD_GL_VERSION_4_2 && glTexStorage2D;
+    if (immutable) {
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei) levels.size(), internalFormat, width, height);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) levels.size() - 1);
+    }
+    for (size_t level = 0; level < levels.size(); ++level) {
+        int w = std::max(width >> level, 1);
+        int h = std::max(height >> level, 1);
+        if (immutable) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint) level, 0, 0, w, h, internalFormat,
+                                      (GLsizei) levels[level].size, levels[level].data);
+        } else {
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint) level, internalFormat, w, h, 0,
+                                   (GLsizei) levels[level].size, levels[level].data);
+        }
+    }
+    applySwizzle(internalFormat);
+}
+
+GLuint createCompressedTexture(const CompressedImage &image, const std::string &name) {
+    GLuint texid;
+    glGenTextures(1, &texid);
+    glBindTexture(GL_TEXTURE_2D, texid);
+
+    std::vector<CompressedLevel> levels;
+    for (const auto &level : image.levels) {
+        CompressedLevel l = {level.data(), level.size()};
+        levels.push_back(l);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        loadreport::Stage stage("texture upload");
+        compressedStorage(compressedFormat(image.format), image.width, image.height, levels);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    loadreport::addUploaded("texture", name, image.size(), ms);
+    return texid;
+}
+
+GLuint createTexture(tinygltf::Model &model, int imageIndex) {
+
+    GLuint texid;
+    glGenTextures(1, &texid);
+
+    tinygltf::Image &image = model.images[imageIndex];
+
+    glBindTexture(GL_TEXTURE_2D, texid);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLenum format, type;
+    pixelFormat(image, format, type);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        loadreport::Stage stage("texture upload");
+        textureStorage(sizedFormat(image), format, type, image.width, image.height);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height,
+                        format, type, &image.image.at(0));
+    }
+    {
+        loadreport::Stage stage("generate mipmaps");
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    loadreport::addUploaded("texture", assetName(image, imageIndex), image.image.size(), ms);
+    return texid;
+}
+
+GLuint createSampler(const tinygltf::Model &model, int sampler) {
+    // an undefined filter leaves the choice to the viewer, trilinear is the usual one
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+    if (sampler >= 0) {
+        const tinygltf::Sampler &s = model.samplers[sampler];
+        if (s.minFilter != -1) minFilter = s.minFilter;
+        if (s.magFilter != -1) magFilter = s.magFilter;
+        wrapS = s.wrapS;
+        wrapT = s.wrapT;
+    }
+
+    GLuint id;
+    glGenSamplers(1, &id);
+    glSamplerParameteri(id, GL_TEXTURE_MIN_FILTER, minFilter);
+    glSamplerParameteri(id, GL_TEXTURE_MAG_FILTER, magFilter);
+    glSamplerParameteri(id, GL_TEXTURE_WRAP_S, wrapS);
+    glSamplerParameteri(id, GL_TEXTURE_WRAP_T, wrapT);
+    return id;
+}
+
+GLuint TextureCache::texture(RenderScene &scene, int texIndex) {
+    int image = model.textures[texIndex].source;
+    auto found = textures.find(image);
+    if (found != textures.end()) {
+        reusedCount++;
+        const CompressedImage *blocks = loaded.compressed(image);
+        reusedBytes += blocks ? blocks->size() : model.images[image].image.size();
+        return found->second;
+    }
+
+    GLuint texid;
+    if (const CompressedImage *blocks = loaded.compressed(image)) {
+        texid = createCompressedTexture(*blocks, assetName(model.images[image], image));
+    } else {
+        texid = createTexture(model, image);
+    }
+    scene.textures.push_back(texid);
+    textures[image] = texid;
+    createdCount++;
+    return texid;
+}
+
+GLuint TextureCache::sampler(RenderScene &scene, int texIndex) {
+    int sampler = model.textures[texIndex].sampler;
+    auto found = samplers.find(sampler);
+    if (found != samplers.end()) return found->second;
+
+    GLuint id = createSampler(model, sampler);
+    scene.samplers.push_back(id);
+    samplers[sampler] = id;
+    return id;
+}
+
+void TextureCache::printStats() const {
+    if (createdCount == 0) return;
+    std::cout << "textures: " << createdCount << " created, " << reusedCount << " reused ("
+              << reusedBytes / (1024.0 * 1024.0) << " MB not uploaded again), "
+              << samplers.size() << " sampler objects" << std::endl;
+}
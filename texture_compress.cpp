@@ -0,0 +1,689 @@
+#include "include/texture_compress.h"
+#include "include/load_report.h"
+#include "include/loader.h"
+#include "include/mapped_file.h"
+#include "include/scene_cache.h"
+#include "include/texture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+
+namespace {
+
+const char BLOCK_MAGIC[8] = {'g', 'l', 'T', 'F', 'b', 'l', 'o', 'k'};
+// bump when the encoder changes, older files are then recompressed
+const uint32_t BLOCK_VERSION = 1;
+// largest width or height a block file may claim, beyond any GL texture size
+const uint32_t MAX_DIMENSION = 1u << 16;
+
+// 4x4 texels of one block, RGBA whatever the channel count of the image
+struct Block {
+    unsigned char texels[16][4];
+};
+
+// copies the block at (bx, by), edge texels repeat where the image is not a multiple of 4
+void loadBlock(const unsigned char *pixels, int width, int height, int channels, int bx, int by, Block &block) {
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const unsigned char *src = pixels + ((size_t) sy * width + sx) * channels;
+            unsigned char *dst = block.texels[y * 4 + x];
+            dst[0] = dst[1] = dst[2] = 0;
+            dst[3] = 255;
+            for (int c = 0; c < channels; ++c) dst[c] = src[c];
+        }
+    }
+}
+
+uint16_t pack565(int r, int g, int b) {
+    return (uint16_t) (((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+void unpack565(uint16_t c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1 color block: endpoints from the inset bounding box along the diagonal the
+// colors spread on, every texel takes the nearest of the four palette entries
+void encodeColor(const Block &block, unsigned char out[8]) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            int v = block.texels[i][c];
+            lo[c] = std::min(lo[c], v);
+            hi[c] = std::max(hi[c], v);
+            mean[c] += v;
+        }
+    }
+    for (int c = 0; c < 3; ++c) mean[c] = (mean[c] + 8) / 16;
+
+    // the box has four diagonals, green decides the direction of red and blue
+    int covRG = 0, covBG = 0;
+    for (int i = 0; i < 16; ++i) {
+        int g = block.texels[i][1] - mean[1];
+        covRG += (block.texels[i][0] - mean[0]) * g;
+        covBG += (block.texels[i][2] - mean[2]) * g;
+    }
+    if (covRG < 0) std::swap(lo[0], hi[0]);
+    if (covBG < 0) std::swap(lo[2], hi[2]);
+
+    // pulling the endpoints in by 1/16 of the range lowers the average error
+    for (int c = 0; c < 3; ++c) {
+        int inset = (hi[c] - lo[c]) / 16;
+        hi[c] -= inset;
+        lo[c] += inset;
+    }
+
+    uint16_t c0 = pack565(hi[0], hi[1], hi[2]);
+    uint16_t c1 = pack565(lo[0], lo[1], lo[2]);
+    // c0 > c1 selects the four color mode
+    if (c0 < c1) std::swap(c0, c1);
+
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int dr = block.texels[i][0] - palette[p][0];
+                int dg = block.texels[i][1] - palette[p][1];
+                int db = block.texels[i][2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t) best << (2 * i);
+        }
+    }
+
+    out[0] = (unsigned char) (c0 & 0xff);
+    out[1] = (unsigned char) (c0 >> 8);
+    out[2] = (unsigned char) (c1 & 0xff);
+    out[3] = (unsigned char) (c1 >> 8);
+    for (int i = 0; i < 4; ++i) out[4 + i] = (unsigned char) (indices >> (8 * i));
+}
+
+// BC4 block of channel `channel`: min and max as endpoints with six values between them
+void encodeChannel(const Block &block, int channel, unsigned char out[8]) {
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, (int) block.texels[i][channel]);
+        hi = std::max(hi, (int) block.texels[i][channel]);
+    }
+
+    // a0 > a1 selects the eight value mode
+    int palette[8] = {hi, lo};
+    for (int p = 2; p < 8; ++p) palette[p] = ((8 - p) * hi + (p - 1) * lo + 3) / 7;
+
+    uint64_t indices = 0;
+    if (hi != lo) {
+        for (int i = 0; i < 16; ++i) {
+            int v = block.texels[i][channel];
+            int best = 0, bestError = 256;
+            for (int p = 0; p < 8; ++p) {
+                int error = std::abs(v - palette[p]);
+                if (error < bestError) {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t) best << (3 * i);
+        }
+    }
+
+    out[0] = (unsigned char) hi;
+    out[1] = (unsigned char) lo;
+    for (int i = 0; i < 6; ++i) out[2 + i] = (unsigned char) (indices >> (8 * i));
+}
+
+// BC7 interpolation weights of 4-bit indices, out of 64
+const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+int bc7Interpolate(int e0, int e1, int index) {
+    return ((64 - BC7_WEIGHTS4[index]) * e0 + BC7_WEIGHTS4[index] * e1 + 32) >> 6;
+}
+
+// 7-bit RGBA endpoint with a p-bit as the shared low bit, the p-bit with the smaller error wins
+void quantizeBc7Endpoint(const float v[4], int q[4], int &pbit) {
+    int bestError = 1 << 30;
+    for (int p = 0; p < 2; ++p) {
+        int error = 0, candidate[4];
+        for (int c = 0; c < 4; ++c) {
+            int c7 = std::min(std::max((int) std::lround((v[c] - p) / 2.0f), 0), 127);
+            candidate[c] = c7;
+            int d = ((c7 << 1) | p) - (int) std::lround(std::min(std::max(v[c], 0.0f), 255.0f));
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            std::copy(candidate, candidate + 4, q);
+        }
+    }
+}
+
+// nearest of the 16 palette entries for every texel, returns the squared error of the block
+int indexBc7(const Block &block, const int e0[4], const int e1[4], int indices[16]) {
+    int palette[16][4];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) palette[i][c] = bc7Interpolate(e0[c], e1[c], i);
+    }
+    int total = 0;
+    for (int t = 0; t < 16; ++t) {
+        int best = 0, bestError = 1 << 30;
+        for (int i = 0; i < 16; ++i) {
+            int error = 0;
+            for (int c = 0; c < 4; ++c) {
+                int d = block.texels[t][c] - palette[i][c];
+                error += d * d;
+            }
+            if (error < bestError) {
+                bestError = error;
+                best = i;
+            }
+        }
+        indices[t] = best;
+        total += bestError;
+    }
+    return total;
+}
+
+// writes `bits` low bits of `value` at bit `pos` of a 16 byte block
+void putBits(unsigned char out[16], int &pos, uint32_t value, int bits) {
+    for (int i = 0; i < bits; ++i, ++pos) {
+        if (value >> i & 1) out[pos >> 3] |= (unsigned char) (1 << (pos & 7));
+    }
+}
+
+// BC7 mode 6, one RGBA subset: endpoints at the ends of the principal axis of
+// the texels, refitted once by least squares on the indices they gave
+void encodeBc7(const Block &block, unsigned char out[16]) {
+    float mean[4] = {0, 0, 0, 0};
+    for (int t = 0; t < 16; ++t) {
+        for (int c = 0; c < 4; ++c) mean[c] += block.texels[t][c] / 16.0f;
+    }
+    float cov[4][4] = {};
+    for (int t = 0; t < 16; ++t) {
+        float d[4];
+        for (int c = 0; c < 4; ++c) d[c] = block.texels[t][c] - mean[c];
+        for (int a = 0; a < 4; ++a) {
+            for (int b = 0; b < 4; ++b) cov[a][b] += d[a] * d[b];
+        }
+    }
+    // a few power iterations from the diagonal find the axis well enough
+    float axis[4] = {1, 1, 1, 1};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = {0, 0, 0, 0}, length = 0.0f;
+        for (int a = 0; a < 4; ++a) {
+            for (int b = 0; b < 4; ++b) next[a] += cov[a][b] * axis[b];
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if (length == 0.0f) break;
+        for (int a = 0; a < 4; ++a) axis[a] = next[a] / length;
+    }
+    float axisLength = 0.0f;
+    for (int c = 0; c < 4; ++c) axisLength += axis[c] * axis[c];
+    float lo = 0.0f, hi = 0.0f;
+    for (int t = 0; t < 16 && axisLength > 0.0f; ++t) {
+        float projection = 0.0f;
+        for (int c = 0; c < 4; ++c) projection += (block.texels[t][c] - mean[c]) * axis[c];
+        projection /= axisLength;
+        lo = std::min(lo, projection);
+        hi = std::max(hi, projection);
+    }
+    float v0[4], v1[4];
+    for (int c = 0; c < 4; ++c) {
+        v0[c] = mean[c] + lo * axis[c];
+        v1[c] = mean[c] + hi * axis[c];
+    }
+
+    int q0[4], q1[4], p0 = 0, p1 = 0, e0[4], e1[4], indices[16];
+    quantizeBc7Endpoint(v0, q0, p0);
+    quantizeBc7Endpoint(v1, q1, p1);
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = (q0[c] << 1) | p0;
+        e1[c] = (q1[c] << 1) | p1;
+    }
+    int error = indexBc7(block, e0, e1, indices);
+
+    // least squares endpoints for the weights the indices picked
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[4] = {0, 0, 0, 0}, bx[4] = {0, 0, 0, 0};
+    for (int t = 0; t < 16; ++t) {
+        float w = BC7_WEIGHTS4[indices[t]] / 64.0f;
+        aa += (1 - w) * (1 - w);
+        ab += (1 - w) * w;
+        bb += w * w;
+        for (int c = 0; c < 4; ++c) {
+            ax[c] += (1 - w) * block.texels[t][c];
+            bx[c] += w * block.texels[t][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::fabs(det) > 1e-6f) {
+        float r0[4], r1[4];
+        for (int c = 0; c < 4; ++c) {
+            r0[c] = (ax[c] * bb - bx[c] * ab) / det;
+            r1[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+        int s0[4], s1[4], sp0 = 0, sp1 = 0, f0[4], f1[4], refitted[16];
+        quantizeBc7Endpoint(r0, s0, sp0);
+        quantizeBc7Endpoint(r1, s1, sp1);
+        for (int c = 0; c < 4; ++c) {
+            f0[c] = (s0[c] << 1) | sp0;
+            f1[c] = (s1[c] << 1) | sp1;
+        }
+        int refittedError = indexBc7(block, f0, f1, refitted);
+        if (refittedError < error) {
+            std::copy(s0, s0 + 4, q0);
+            std::copy(s1, s1 + 4, q1);
+            std::copy(refitted, refitted + 16, indices);
+            p0 = sp0;
+            p1 = sp1;
+        }
+    }
+
+    // the first index is stored without its top bit, so it has to be below 8
+    if (indices[0] >= 8) {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for (int &index : indices) index = 15 - index;
+    }
+
+    std::memset(out, 0, 16);
+    int pos = 0;
+    putBits(out, pos, 1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        putBits(out, pos, (uint32_t) q0[c], 7);
+        putBits(out, pos, (uint32_t) q1[c], 7);
+    }
+    putBits(out, pos, (uint32_t) p0, 1);
+    putBits(out, pos, (uint32_t) p1, 1);
+    putBits(out, pos, (uint32_t) indices[0], 3);
+    for (int t = 1; t < 16; ++t) putBits(out, pos, (uint32_t) indices[t], 4);
+}
+
+void compressLevel(const unsigned char *pixels, int width, int height, int channels, BlockFormat format,
+                   std::vector<unsigned char> &out) {
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t bytes = blockBytes(format);
+    out.resize((size_t) blocksX * blocksY * bytes);
+
+    Block block;
+    unsigned char *dst = out.data();
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx, dst += bytes) {
+            loadBlock(pixels, width, height, channels, bx, by, block);
+            switch (format) {
+            case BLOCK_BC1:
+                encodeColor(block, dst);
+                break;
+            case BLOCK_BC3:
+                encodeChannel(block, 3, dst);
+                encodeColor(block, dst + 8);
+                break;
+            case BLOCK_BC4:
+                encodeChannel(block, 0, dst);
+                break;
+            case BLOCK_BC5:
+                encodeChannel(block, 0, dst);
+                encodeChannel(block, 1, dst + 8);
+                break;
+            case BLOCK_BC7:
+                encodeBc7(block, dst);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+// the decoders below only serve benchmarkCompress, which measures the encoders' error
+
+// BC1 color block into the RGB of `block`
+void decodeColor(const unsigned char in[8], Block &block) {
+    uint16_t c0 = (uint16_t) (in[0] | in[1] << 8), c1 = (uint16_t) (in[2] | in[3] << 8);
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (c0 > c1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    uint32_t indices = (uint32_t) in[4] | (uint32_t) in[5] << 8 | (uint32_t) in[6] << 16 | (uint32_t) in[7] << 24;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) block.texels[i][c] = (unsigned char) palette[indices >> (2 * i) & 3][c];
+    }
+}
+
+// BC4 block into channel `channel` of `block`
+void decodeChannel(const unsigned char in[8], int channel, Block &block) {
+    int a0 = in[0], a1 = in[1], palette[8] = {a0, a1};
+    for (int p = 2; p < 8; ++p) {
+        if (a0 > a1) {
+            palette[p] = ((8 - p) * a0 + (p - 1) * a1 + 3) / 7;
+        } else {
+            palette[p] = p < 6 ? ((6 - p) * a0 + (p - 1) * a1 + 2) / 5 : (p == 6 ? 0 : 255);
+        }
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i) indices |= (uint64_t) in[2 + i] << (8 * i);
+    for (int i = 0; i < 16; ++i) block.texels[i][channel] = (unsigned char) palette[indices >> (3 * i) & 7];
+}
+
+uint32_t getBits(const unsigned char in[16], int &pos, int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; ++i, ++pos) value |= (uint32_t) (in[pos >> 3] >> (pos & 7) & 1) << i;
+    return value;
+}
+
+// BC7 block, mode 6 only since that is all encodeBc7 writes; false for the other modes
+bool decodeBc7(const unsigned char in[16], Block &block) {
+    if ((in[0] & 0x7f) != 0x40) return false;
+    int pos = 7, q[2][4];
+    for (int c = 0; c < 4; ++c) {
+        q[0][c] = (int) getBits(in, pos, 7);
+        q[1][c] = (int) getBits(in, pos, 7);
+    }
+    int p0 = (int) getBits(in, pos, 1), p1 = (int) getBits(in, pos, 1);
+    for (int t = 0; t < 16; ++t) {
+        int index = (int) getBits(in, pos, t == 0 ? 3 : 4);
+        for (int c = 0; c < 4; ++c) {
+            block.texels[t][c] = (unsigned char) bc7Interpolate((q[0][c] << 1) | p0, (q[1][c] << 1) | p1, index);
+        }
+    }
+    return true;
+}
+
+// decodes level 0 of `blocks` and returns its PSNR against `pixels` over the first `channels` channels
+double levelPsnr(const unsigned char *pixels, int width, int height, int channels, BlockFormat format,
+                 const std::vector<unsigned char> &blocks) {
+    int blocksX = (width + 3) / 4;
+    size_t bytes = blockBytes(format);
+    double squared = 0.0;
+    Block block;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            // every block is decoded once, at its top left texel
+            if ((x & 3) == 0 && (y & 3) == 0) {
+                const unsigned char *src = blocks.data() + ((size_t) (y / 4) * blocksX + x / 4) * bytes;
+                std::memset(&block, 255, sizeof(block));
+                switch (format) {
+                case BLOCK_BC1: decodeColor(src, block); break;
+                case BLOCK_BC3: decodeChannel(src, 3, block); decodeColor(src + 8, block); break;
+                case BLOCK_BC4: decodeChannel(src, 0, block); break;
+                case BLOCK_BC5: decodeChannel(src, 0, block); decodeChannel(src + 8, 1, block); break;
+                case BLOCK_BC7: if (!decodeBc7(src, block)) return 0.0; break;
+                default: return 0.0;
+                }
+                for (int by = 0; by < 4 && y + by < height; ++by) {
+                    for (int bx = 0; bx < 4 && x + bx < width; ++bx) {
+                        const unsigned char *texel = pixels + ((size_t) (y + by) * width + x + bx) * channels;
+                        for (int c = 0; c < channels; ++c) {
+                            double d = (double) texel[c] - block.texels[by * 4 + bx][c];
+                            squared += d * d;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    double mse = squared / ((double) width * height * channels);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// next mip level with a 2x2 box filter, odd edges reuse their last row or column
+void downsample(const std::vector<unsigned char> &src, int width, int height, int channels,
+                std::vector<unsigned char> &dst, int &nextWidth, int &nextHeight) {
+    nextWidth = std::max(width / 2, 1);
+    nextHeight = std::max(height / 2, 1);
+    dst.resize((size_t) nextWidth * nextHeight * channels);
+    for (int y = 0; y < nextHeight; ++y) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < nextWidth; ++x) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < channels; ++c) {
+                int sum = src[((size_t) y0 * width + x0) * channels + c] + src[((size_t) y0 * width + x1) * channels + c]
+                        + src[((size_t) y1 * width + x0) * channels + c] + src[((size_t) y1 * width + x1) * channels + c];
+                dst[((size_t) y * nextWidth + x) * channels + c] = (unsigned char) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+bool opaque(const tinygltf::Image &image) {
+    for (size_t i = 3; i < image.image.size(); i += 4) {
+        if (image.image[i] != 255) return false;
+    }
+    return true;
+}
+
+// every level of an 8-bit image in `format`, the mip chain built with the box filter
+void compressChain(const tinygltf::Image &image, BlockFormat format, CompressedImage &out) {
+    int channels = image.component;
+    out.format = format;
+    out.width = image.width;
+    out.height = image.height;
+    out.levels.clear();
+
+    std::vector<unsigned char> level = image.image, next;
+    int width = image.width, height = image.height;
+    while (true) {
+        out.levels.push_back(std::vector<unsigned char>());
+        compressLevel(level.data(), width, height, channels, out.format, out.levels.back());
+        if (width == 1 && height == 1) break;
+        downsample(level, width, height, channels, next, width, height);
+        level.swap(next);
+    }
+}
+
+}
+
+
+size_t CompressedImage::size() const {
+    size_t bytes = 0;
+    for (const auto &level : levels) bytes += level.size();
+    return bytes;
+}
+
+size_t blockBytes(BlockFormat format) {
+    return format == BLOCK_BC1 || format == BLOCK_BC1A || format == BLOCK_BC4 ? 8 : 16;
+}
+
+size_t levelBytes(BlockFormat format, int width, int height, int level) {
+    size_t w = (size_t) std::max(width >> level, 1), h = (size_t) std::max(height >> level, 1);
+    return ((w + 3) / 4) * ((h + 3) / 4) * blockBytes(format);
+}
+
+bool compressImage(const tinygltf::Image &image, CompressedImage &out, bool bc7) {
+    if (image.bits != 8 || image.component < 1 || image.component > 4 || image.image.empty()) return false;
+    loadreport::Stage stage("compress textures");
+
+    int channels = image.component;
+    static const BlockFormat formats[4] = {BLOCK_BC4, BLOCK_BC5, BLOCK_BC1, BLOCK_BC3};
+    BlockFormat format = formats[channels - 1];
+    if (channels == 4 && opaque(image)) format = BLOCK_BC1;
+    // BC7 takes the place of BC3 at the same size, alpha no longer costs the color its precision
+    if (format == BLOCK_BC3 && bc7) format = BLOCK_BC7;
+    compressChain(image, format, out);
+    return true;
+}
+
+std::string compressedImagePath(const std::string &directory, const unsigned char *encoded, size_t size, bool bc7) {
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx%s.blocks", (unsigned long long) SceneCache::hashBytes(encoded, size),
+             bc7 ? "-bc7" : "");
+    return directory + "/" + name;
+}
+
+bool readCompressedImage(const std::string &path, CompressedImage &image) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    loadreport::addRead(path, file.size());
+
+    const unsigned char *cur = file.data();
+    const unsigned char *end = cur + file.size();
+    uint32_t header[5];
+    if (file.size() < sizeof(BLOCK_MAGIC) + sizeof(header) || std::memcmp(cur, BLOCK_MAGIC, 8) != 0) return false;
+    std::memcpy(header, cur + 8, sizeof(header));
+    cur += 8 + sizeof(header);
+    // version, format, width, height, levels
+    if (header[0] != BLOCK_VERSION || header[1] == BLOCK_NONE || header[1] > BLOCK_BC1A) return false;
+
+    // a corrupt or truncated file is rejected before anything is sized from it, it is then recompressed
+    if (header[2] == 0 || header[3] == 0 || header[2] > MAX_DIMENSION || header[3] > MAX_DIMENSION) return false;
+    image.format = (BlockFormat) header[1];
+    image.width = (int) header[2];
+    image.height = (int) header[3];
+    if (header[4] == 0 || header[4] > (uint32_t) mipLevels(image.width, image.height)) return false;
+
+    image.levels.resize(header[4]);
+    for (size_t i = 0; i < image.levels.size(); ++i) {
+        uint64_t size;
+        if ((size_t) (end - cur) < sizeof(size)) return false;
+        std::memcpy(&size, cur, sizeof(size));
+        cur += sizeof(size);
+        if (size != levelBytes(image.format, image.width, image.height, (int) i) || (uint64_t) (end - cur) < size) {
+            return false;
+        }
+        image.levels[i].assign(cur, cur + size);
+        cur += size;
+    }
+    return true;
+}
+
+bool writeCompressedImage(const std::string &path, const CompressedImage &image) {
+    makeDirectory(path.substr(0, path.find_last_of('/')));
+    // images with the same bytes may be written by two workers at once
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%p.tmp", (const void *) &image);
+    std::string tmpPath = path + suffix;
+
+    std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    uint32_t header[5] = {BLOCK_VERSION, image.format, (uint32_t) image.width, (uint32_t) image.height,
+                          (uint32_t) image.levels.size()};
+    out.write(BLOCK_MAGIC, 8);
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    for (const auto &level : image.levels) {
+        uint64_t size = level.size();
+        out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        out.write(reinterpret_cast<const char *>(level.data()), (std::streamsize) size);
+    }
+    out.close();
+    if (!out) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+void benchmarkCompress(const std::string &filename, int runs) {
+    LoadOptions options;
+    options.verbose = false;
+    LoadedModel loaded;
+    std::vector<tinygltf::Image> images;
+    if (loadModel(loaded, filename, options)) {
+        for (const tinygltf::Image &image : loaded.model.images) {
+            if (image.bits == 8 && image.component >= 1 && image.component <= 4 && !image.image.empty()) {
+                images.push_back(image);
+            }
+        }
+    }
+    if (images.empty()) {
+        // smooth color ramps with a soft alpha edge and a little noise, like a decal
+        tinygltf::Image image;
+        image.width = image.height = 1024;
+        image.component = 4;
+        image.bits = 8;
+        image.image.resize((size_t) 1024 * 1024 * 4);
+        uint32_t noise = 1;
+        for (int y = 0; y < 1024; ++y) {
+            for (int x = 0; x < 1024; ++x) {
+                noise = noise * 1664525u + 1013904223u;
+                unsigned char *texel = &image.image[((size_t) y * 1024 + x) * 4];
+                texel[0] = (unsigned char) (x / 4);
+                texel[1] = (unsigned char) (y / 4);
+                texel[2] = (unsigned char) (128 + 100 * std::sin(x * 0.02f) * std::cos(y * 0.03f) + (noise >> 29));
+                texel[3] = (unsigned char) std::min(255, std::max(0, (x + y - 768) / 2));
+            }
+        }
+        images.push_back(image);
+        std::cout << "no 8-bit images in " << filename << ", compressing a synthetic 1024x1024 RGBA image" << std::endl;
+    }
+
+    // every format an image could be given: its own, and BC7 in place of BC1 and BC3
+    struct Totals {
+        int images = 0;
+        double ms = 0.0, psnr = 0.0;
+        size_t rawBytes = 0, blockBytes = 0;
+    };
+    std::map<BlockFormat, Totals> totals;
+    for (const tinygltf::Image &image : images) {
+        std::vector<BlockFormat> formats;
+        switch (image.component) {
+        case 1: formats = {BLOCK_BC4}; break;
+        case 2: formats = {BLOCK_BC5}; break;
+        case 3: formats = {BLOCK_BC1, BLOCK_BC7}; break;
+        default: formats = {opaque(image) ? BLOCK_BC1 : BLOCK_BC3, BLOCK_BC7}; break;
+        }
+        for (BlockFormat format : formats) {
+            CompressedImage out;
+            double best = 0.0;
+            for (int i = 0; i < runs; ++i) {
+                auto start = std::chrono::steady_clock::now();
+                compressChain(image, format, out);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best = i == 0 ? ms : std::min(best, ms);
+            }
+            Totals &total = totals[format];
+            total.images++;
+            total.ms += best;
+            total.psnr += levelPsnr(image.image.data(), image.width, image.height, image.component, format,
+                                    out.levels[0]);
+            total.rawBytes += (size_t) image.width * image.height * image.component;
+            total.blockBytes += out.levels[0].size();
+        }
+    }
+
+    static const char *names[] = {"", "BC1", "BC3", "BC4", "BC5", "BC7", "BC1A"};
+    for (const auto &entry : totals) {
+        const Totals &total = entry.second;
+        std::cout << names[entry.first] << ": " << total.images << " images, "
+                  << total.rawBytes / (1024.0 * 1024.0) / (total.ms / 1000.0) << " MB/s with its mip chain on one thread, "
+                  << (double) total.rawBytes / total.blockBytes << "x smaller than the 8-bit texels, mean PSNR "
+                  << total.psnr / total.images << " dB" << std::endl;
+    }
+}
@@ -0,0 +1,213 @@
+#include "include/texture_streamer.h"
+#include "include/load_report.h"
+#include "include/texture.h"
+
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <set>
+
+// pixel buffer objects rows are copied through, used round robin and orphaned on every use
+const int PBO_COUNT = 4;
+const size_t PBO_SIZE = 4u << 20;
+
+
+// the deferred images some draw of `scene` waits for, the encoded bytes of the others are freed
+std::vector<PendingImage> drawnImages(LoadedModel &loaded, const RenderScene &scene) {
+    std::set<int> sources;
+    for (const auto &pending : scene.pendingTextures) {
+        sources.insert(loaded.model.textures[pending.second].source);
+    }
+    std::vector<PendingImage> drawn;
+    for (PendingImage &image : loaded.pendingImages) {
+        if (sources.count(image.index)) drawn.push_back(std::move(image));
+    }
+    if (drawn.size() < loaded.pendingImages.size()) {
+        std::cout << "streaming " << drawn.size() << " of " << loaded.pendingImages.size()
+                  << " deferred images, no draw samples the others" << std::endl;
+    }
+    std::vector<PendingImage>().swap(loaded.pendingImages);
+    return drawn;
+}
+
+
+TextureStreamer::TextureStreamer(LoadedModel &loaded, const RenderScene &scene, unsigned int threads, double budgetMs)
+    : loaded(loaded), images(drawnImages(loaded, scene)), decodedOk(images.size(), 0),
+      budgetMs(budgetMs), remaining(images.size()), cancelled(false), pool(threads)
+{
+    pbos.resize(PBO_COUNT);
+    glGenBuffers(PBO_COUNT, pbos.data());
+
+    for (size_t i = 0; i < images.size(); ++i) {
+        pool.submit([this, i] {
+            if (cancelled) return;
+
+            std::string err, warn;
+            // every job writes a distinct element of model.images and compressedImages
+            decodedOk[i] = prepareImage(this->loaded, images[i], err, warn);
+            if (!err.empty()) {
+                std::cout << "ERR: " << err << std::endl;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(i);
+        });
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    cancelled = true;
+    glDeleteBuffers((GLsizei) pbos.size(), pbos.data());
+    if (active) {
+        glDeleteTextures(1, &current.texture);
+    }
+}
+
+float TextureStreamer::priority(const RenderScene &scene, size_t image, const glm::vec3 &eye) const
+{
+    // (radius / distance)^2 follows the screen area of a bounding sphere
+    float best = 0.0f;
+    const tinygltf::Model &model = loaded.model;
+    for (const auto &pending : scene.pendingTextures) {
+        if (model.textures[pending.second].source != images[image].index) continue;
+        const DrawItem &item = scene.draws[pending.first];
+        float distance = std::max(glm::length(item.center - eye), item.radius);
+        float coverage = distance > 0.0f ? item.radius / distance : 1.0f;
+        best = std::max(best, coverage * coverage);
+    }
+    return best;
+}
+
+bool TextureStreamer::uploadBand()
+{
+    const tinygltf::Image &image = loaded.model.images[images[current.image].index];
+    GLenum format, type;
+    pixelFormat(image, format, type);
+    size_t rowBytes = (size_t) image.width * image.component * (image.bits / 8);
+    int rows = (int) std::max<size_t>(1, PBO_SIZE / rowBytes);
+    rows = std::min(rows, image.height - current.row);
+    size_t bytes = rowBytes * rows;
+
+    // orphaning hands back fresh storage, so the copy never waits for an earlier band
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+    nextPbo = (nextPbo + 1) % pbos.size();
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr) std::max(bytes, PBO_SIZE), NULL, GL_STREAM_DRAW);
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr) bytes,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (dst) {
+        std::memcpy(dst, image.image.data() + rowBytes * current.row, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindTexture(GL_TEXTURE_2D, current.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, current.row, image.width, rows, format, type, 0);
+    }
+    // a bound unpack buffer would turn every other upload's pointer into an offset
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    loadreport::addUploaded("texture", assetName(image, images[current.image].index), bytes, 0.0);
+
+    current.row += rows;
+    return current.row >= image.height;
+}
+
+void TextureStreamer::complete(RenderScene &scene, size_t i, GLuint texture)
+{
+    tinygltf::Model &model = loaded.model;
+    int image = images[i].index;
+    if (texture) {
+        // compressed images come with their mip chain
+        if (!loaded.compressed(image)) {
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        scene.textures.push_back(texture);
+    }
+
+    for (auto it = scene.pendingTextures.begin(); it != scene.pendingTextures.end();) {
+        if (model.textures[it->second].source != image) {
+            ++it;
+            continue;
+        }
+        scene.draws[it->first].material.baseColorId = texture;
+        it = scene.pendingTextures.erase(it);
+    }
+    // every draw waiting for the image has its texture, the texels live on the GPU now
+    std::vector<unsigned char>().swap(model.images[image].image);
+    if (!loaded.compressedImages.empty()) {
+        loaded.compressedImages[image] = CompressedImage();
+    }
+    remaining--;
+}
+
+int TextureStreamer::upload(RenderScene &scene, const glm::vec3 &eye)
+{
+    loadreport::Stage stage("texture streaming");
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.insert(ready.end(), decoded.begin(), decoded.end());
+        decoded.clear();
+    }
+
+    auto overBudget = [&] {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs;
+    };
+
+    int completed = 0;
+    while (active || !ready.empty()) {
+        if (!active) {
+            // the image covering most of the screen goes first
+            auto best = ready.begin();
+            float bestPriority = -1.0f;
+            for (auto it = ready.begin(); it != ready.end(); ++it) {
+                float p = priority(scene, *it, eye);
+                if (p > bestPriority) {
+                    bestPriority = p;
+                    best = it;
+                }
+            }
+            size_t i = *best;
+            ready.erase(best);
+
+            if (!decodedOk[i]) {
+                complete(scene, i, 0);
+                continue;
+            }
+
+            // a compressed mip chain is a fraction of the pixels, it goes up in one piece
+            if (const CompressedImage *blocks = loaded.compressed(images[i].index)) {
+                int index = images[i].index;
+                complete(scene, i, createCompressedTexture(*blocks, assetName(loaded.model.images[index], index)));
+                completed++;
+                if (overBudget()) break;
+                continue;
+            }
+
+            const tinygltf::Image &image = loaded.model.images[images[i].index];
+            GLenum format, type;
+            pixelFormat(image, format, type);
+            current.image = i;
+            current.row = 0;
+            glGenTextures(1, &current.texture);
+            glBindTexture(GL_TEXTURE_2D, current.texture);
+            textureStorage(sizedFormat(image), format, type, image.width, image.height);
+            active = true;
+        }
+
+        // at least one band per frame so streaming always makes progress
+        if (uploadBand()) {
+            active = false;
+            complete(scene, current.image, current.texture);
+            completed++;
+        }
+
+        if (overBudget()) break;
+    }
+    streamed += completed;
+    if (remaining == 0) {
+        std::cout << "textures: " << streamed << " streamed" << std::endl;
+    }
+    return completed;
+}